@@ -24,6 +24,9 @@ struct Assembler {
 
     virtual void func(TypeReference const& type) = 0;
 
+    // Marks where the code of a source line begins, for assemblers that keep debug info
+    virtual void line(size_t line) {}
+
     virtual void beginFunction() = 0;
     virtual void endFunction() = 0;
 
@@ -27,10 +27,26 @@ Continuum::Continuum() {
     context->defineExternal("eof", std::make_shared<FuncType>(std::vector<TypeReference>{}, ScalarTypes::BOOL));
     context->defineExternal("typename", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY}, ScalarTypes::STRING));
     context->defineExternal("gc", std::make_shared<FuncType>(std::vector<TypeReference>{}, ScalarTypes::NONE));
+    context->defineExternal("gcStats", std::make_shared<FuncType>(std::vector<TypeReference>{}, std::make_shared<DictType>(ScalarTypes::STRING, ScalarTypes::INT)));
+    context->defineExternal("heapDump", std::make_shared<FuncType>(std::vector{ScalarTypes::STRING}, ScalarTypes::NONE));
+    context->defineExternal("weakDict", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY}, ScalarTypes::ANY));
     context->defineExternal("toBytes", std::make_shared<FuncType>(std::vector{ScalarTypes::STRING}, std::make_shared<ListType>(ScalarTypes::BYTE)));
     context->defineExternal("toChars", std::make_shared<FuncType>(std::vector{ScalarTypes::STRING}, std::make_shared<ListType>(ScalarTypes::CHAR)));
     context->defineExternal("fromBytes", std::make_shared<FuncType>(std::vector<TypeReference>{std::make_shared<ListType>(ScalarTypes::BYTE)}, ScalarTypes::STRING));
     context->defineExternal("fromChars", std::make_shared<FuncType>(std::vector<TypeReference>{std::make_shared<ListType>(ScalarTypes::CHAR)}, ScalarTypes::STRING));
+    context->defineExternal("substring", std::make_shared<FuncType>(std::vector{ScalarTypes::STRING, ScalarTypes::INT, ScalarTypes::INT}, ScalarTypes::STRING));
+    context->defineExternal("find", std::make_shared<FuncType>(std::vector{ScalarTypes::STRING, ScalarTypes::STRING, ScalarTypes::INT}, ScalarTypes::INT));
+    context->defineExternal("split", std::make_shared<FuncType>(std::vector{ScalarTypes::STRING, ScalarTypes::STRING}, std::make_shared<ListType>(ScalarTypes::STRING)));
+    context->defineExternal("range", std::make_shared<FuncType>(std::vector{ScalarTypes::INT, ScalarTypes::INT, ScalarTypes::INT}, std::make_shared<IterType>(ScalarTypes::INT)));
+    context->defineExternal("map", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY, ScalarTypes::ANY}, ScalarTypes::ANY));
+    context->defineExternal("filter", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY, ScalarTypes::ANY}, ScalarTypes::ANY));
+    context->defineExternal("take", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY, ScalarTypes::INT}, ScalarTypes::ANY));
+    context->defineExternal("skip", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY, ScalarTypes::INT}, ScalarTypes::ANY));
+    context->defineExternal("zip", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY, ScalarTypes::ANY}, ScalarTypes::ANY));
+    context->defineExternal("enumerate", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY}, ScalarTypes::ANY));
+    context->defineExternal("chain", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY, ScalarTypes::ANY}, ScalarTypes::ANY));
+    context->defineExternal("persistent", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY}, ScalarTypes::ANY));
+    context->defineExternal("snapshot", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY}, ScalarTypes::ANY));
     context->defineExternal("eval", std::make_shared<FuncType>(std::vector{ScalarTypes::ANY, ScalarTypes::STRING}, ScalarTypes::ANY));
 }
 
@@ -50,7 +50,7 @@ struct LambdaFunctionReference : FunctionReference {
         }
         auto prototype = lambda->parameters->prototype;
         P.insert(P.end(), prototype->P.begin(), prototype->P.end());
-        typeCache = std::make_shared<FuncType>(std::move(P), prototype->R);
+        typeCache = std::static_pointer_cast<FuncType>(intern(std::make_shared<FuncType>(std::move(P), prototype->R)));
     }
 
     void assemble(Assembler* assembler) const override {
@@ -61,7 +61,7 @@ struct LambdaFunctionReference : FunctionReference {
 struct ExternalFunctionReference : FunctionReference {
 
     explicit ExternalFunctionReference(std::shared_ptr<FuncType> type) {
-        typeCache = std::move(type);
+        typeCache = std::static_pointer_cast<FuncType>(intern(std::move(type)));
     }
 
     void assemble(Assembler* assembler) const override {}
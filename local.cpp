@@ -39,6 +39,12 @@ void LocalContext::local(std::string_view name, const TypeReference& type) {
     localTypes.push_back(type);
 }
 
+// a local slot with no name, used by the compiler itself
+size_t LocalContext::hidden(const TypeReference& type) {
+    localTypes.push_back(type);
+    return localTypes.size() - 1;
+}
+
 void LocalContext::declare(std::string_view name, FnDeclExpr* decl) {
     if (name == "_") {
         Error().with(
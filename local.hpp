@@ -25,6 +25,7 @@ struct LocalContext {
     void pop();
     void checkDeclared();
     void local(std::string_view name, TypeReference const& type);
+    size_t hidden(TypeReference const& type);
     void declare(std::string_view name, FnDeclExpr* decl);
     void define(std::string_view name, FnDefExpr* def);
     void defineExternal(std::string_view name, std::shared_ptr<FuncType> const& prototype);
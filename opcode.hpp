@@ -70,6 +70,9 @@ enum class Opcode : uint8_t {
     ITER,
     MOVE,
     GET,
+    NEXT,
+    LNEXT,
+    DNEXT,
     I2S,
     F2S,
     B2S,
@@ -80,6 +83,7 @@ enum class Opcode : uint8_t {
     REMOVE,
     IN,
     SIZEOF,
+    IHASH,
     FHASH,
     OHASH,
     YIELD,
@@ -150,6 +154,9 @@ constexpr std::string_view OPCODE_NAME[] = {
     "iter",
     "move",
     "get",
+    "next",
+    "lnext",
+    "dnext",
     "i2s",
     "f2s",
     "b2s",
@@ -160,6 +167,7 @@ constexpr std::string_view OPCODE_NAME[] = {
     "remove",
     "in",
     "sizeof",
+    "ihash",
     "fhash",
     "ohash",
     "yield",
@@ -230,6 +238,9 @@ const std::unordered_map<std::string_view, Opcode> OPCODES {
     {"iter", Opcode::ITER},
     {"move", Opcode::MOVE},
     {"get", Opcode::GET},
+    {"next", Opcode::NEXT},
+    {"lnext", Opcode::LNEXT},
+    {"dnext", Opcode::DNEXT},
     {"i2s", Opcode::I2S},
     {"f2s", Opcode::F2S},
     {"b2s", Opcode::B2S},
@@ -240,6 +251,7 @@ const std::unordered_map<std::string_view, Opcode> OPCODES {
     {"remove", Opcode::REMOVE},
     {"in", Opcode::IN},
     {"sizeof", Opcode::SIZEOF},
+    {"ihash", Opcode::IHASH},
     {"fhash", Opcode::FHASH},
     {"ohash", Opcode::OHASH},
     {"yield", Opcode::YIELD},
@@ -437,9 +437,11 @@ ExprHandle Parser::parseFor() {
     auto initializer = parseExpression();
     if (auto element = elementof(initializer->getType())) {
         declarator->infer(element);
-        declarator->declare(context);
+        auto layout = ForExpr::declare(context, declarator.get(), initializer.get());
         auto clause = parseClause();
-        return make<ForExpr>(token, std::move(declarator), std::move(initializer), std::move(clause), popLoop());
+        auto loop = make<ForExpr>(token, std::move(declarator), std::move(initializer), std::move(clause), popLoop());
+        loop->layout = layout;
+        return loop;
     } else {
         initializer->expect("iterable type");
     }
@@ -502,7 +504,7 @@ ExprHandle Parser::parseFnBody(std::shared_ptr<FuncType> const& F, bool yield, S
                     error.raise();
                 }
             }
-            type0 = std::make_shared<IterType>(type0);
+            type0 = intern(std::make_shared<IterType>(type0));
         }
     } else {
         clause = parseExpression();
@@ -620,7 +622,7 @@ TypeReference Parser::parseType() {
         case TokenType::IDENTIFIER: {
             auto id = compiler.of(token);
             if (auto it = SCALAR_TYPES.find(id); it != SCALAR_TYPES.end()) {
-                return std::make_shared<ScalarType>(it->second);
+                return ScalarTypes::of(it->second);
             }
             if (id == "typeof") {
                 expect(TokenType::LPAREN, "(");
@@ -672,7 +674,7 @@ TypeReference Parser::parseType() {
                 auto type = parseType();
                 expect(TokenType::RPAREN, ")");
                 if (auto func = dynamic_cast<FuncType*>(type.get())) {
-                    return std::make_shared<TupleType>(func->P);
+                    return intern(std::make_shared<TupleType>(func->P));
                 }
                 Error error;
                 error.with(ErrorMessage().error(token).text("elementof expect a func type but got").type(type));
@@ -685,7 +687,7 @@ TypeReference Parser::parseType() {
             auto E = parseType();
             neverGonnaGiveYouUp(E, "as a list element", rewind());
             expect(TokenType::RBRACKET, "]");
-            return std::make_shared<ListType>(E);
+            return intern(std::make_shared<ListType>(E));
         }
         case TokenType::OP_AT: {
             expect(TokenType::LBRACKET, "[");
@@ -695,10 +697,10 @@ TypeReference Parser::parseType() {
             if (V) {
                 neverGonnaGiveYouUp(K, "as a dict key", rewind());
                 neverGonnaGiveYouUp(V, "as a dict value", rewind());
-                return std::make_shared<DictType>(std::move(K), std::move(V));
+                return intern(std::make_shared<DictType>(std::move(K), std::move(V)));
             } else {
                 neverGonnaGiveYouUp(K, "as a set element", rewind());
-                return std::make_shared<SetType>(std::move(K));
+                return intern(std::make_shared<SetType>(std::move(K)));
             }
         }
         case TokenType::LPAREN: {
@@ -713,7 +715,7 @@ TypeReference Parser::parseType() {
             optionalComma(P.size());
             next();
             if (auto R = optionalType()) {
-                return std::make_shared<FuncType>(std::move(P), std::move(R));
+                return intern(std::make_shared<FuncType>(std::move(P), std::move(R)));
             } else {
                 switch (P.size()) {
                     case 0:
@@ -721,14 +723,14 @@ TypeReference Parser::parseType() {
                     case 1:
                         return P.front();
                     default:
-                        return std::make_shared<TupleType>(std::move(P));
+                        return intern(std::make_shared<TupleType>(std::move(P)));
                 }
             }
         }
         case TokenType::OP_MUL: {
             auto E = parseType();
             neverGonnaGiveYouUp(E, "as a iter element", rewind());
-            return std::make_shared<IterType>(E);
+            return intern(std::make_shared<IterType>(E));
         }
     }
 }
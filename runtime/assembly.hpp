@@ -5,6 +5,7 @@
 #include "../opcode.hpp"
 #include "../type.hpp"
 #include "external.hpp"
+#include "vm.hpp"
 
 
 namespace Porkchop {
@@ -21,6 +22,26 @@ struct Assembly {
     std::vector<std::variant<Instructions, ExternalFunction>> functions;
     std::vector<std::string> table;
     std::vector<std::shared_ptr<FuncType>> prototypes;
+    std::vector<std::unique_ptr<String>> constants;
+    // Debug info: for each function, the first pc of each source line in the order they begin
+    std::vector<std::vector<std::pair<size_t, size_t>>> lines;
+
+    // Returns the 0-based source line of an instruction, if known
+    [[nodiscard]] std::optional<size_t> line(size_t func, size_t pc) const {
+        if (func >= lines.size()) return std::nullopt;
+        auto& table = lines[func];
+        auto it = std::upper_bound(table.begin(), table.end(), std::pair{pc, size_t(-1)});
+        if (it == table.begin()) return std::nullopt;
+        return std::prev(it)->second;
+    }
+
+    // String constants are materialized once on first use and live as long as the assembly
+    String* constant(VM* vm, size_t index) {
+        if (constants.size() <= index) constants.resize(table.size());
+        auto& constant = constants[index];
+        if (!constant) constant = vm->newImmortal<String>(table[index]);
+        return constant.get();
+    }
 
     Assembly() {
         functions.emplace_back(Externals::print);
@@ -38,10 +59,26 @@ struct Assembly {
         functions.emplace_back(Externals::eof);
         functions.emplace_back(Externals::typename_);
         functions.emplace_back(Externals::gc);
+        functions.emplace_back(Externals::gcStats);
+        functions.emplace_back(Externals::heapDump);
+        functions.emplace_back(Externals::weakDict);
         functions.emplace_back(Externals::toBytes);
         functions.emplace_back(Externals::toChars);
         functions.emplace_back(Externals::fromBytes);
         functions.emplace_back(Externals::fromChars);
+        functions.emplace_back(Externals::substring);
+        functions.emplace_back(Externals::find);
+        functions.emplace_back(Externals::split);
+        functions.emplace_back(Externals::range);
+        functions.emplace_back([this](VM* vm, std::vector<$union> const &args) { return Externals::map(vm, this, args); });
+        functions.emplace_back([this](VM* vm, std::vector<$union> const &args) { return Externals::filter(vm, this, args); });
+        functions.emplace_back(Externals::take);
+        functions.emplace_back(Externals::skip);
+        functions.emplace_back(Externals::zip);
+        functions.emplace_back(Externals::enumerate);
+        functions.emplace_back(Externals::chain);
+        functions.emplace_back(Externals::persistent);
+        functions.emplace_back(Externals::snapshot);
         functions.emplace_back(Externals::eval);
     }
 };
@@ -15,15 +15,14 @@ struct ByteStream {
         return (Opcode) next();
     }
 
+    // little-endian base 128, as ByteBuf writes it
     size_t readVarInt() {
         size_t result = 0;
-        uint8_t byte;
-        do {
-            result <<= 7;
-            byte = next();
-            result |= byte & 0x7F;
-        } while (byte & 0x80);
-        return result;
+        for (size_t shift = 0;; shift += 7) {
+            uint8_t byte = next();
+            result |= size_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return result;
+        }
     }
 
     TypeReference readType() {
@@ -68,6 +67,9 @@ struct BinAssembly : Assembly {
                 case Opcode::TLOAD:
                 case Opcode::INC:
                 case Opcode::DEC:
+                case Opcode::NEXT:
+                case Opcode::LNEXT:
+                case Opcode::DNEXT:
                 case Opcode::SJOIN:
                 case Opcode::CONST:
                 case Opcode::UCMP:
@@ -1,14 +1,28 @@
 #pragma once
 
 #include "frame.hpp"
+#include "../diagnostics.hpp"
 
 namespace Porkchop {
 
+inline void configure(VM& vm, int& argc, const char**& argv) try {
+    if (auto flag = vm.configure(argc, argv)) {
+        Error().with(ErrorMessage().fatal().text("unknown garbage collector option: ").text(flag)).report(nullptr);
+        std::exit(12);
+    }
+} catch (Exception& e) {
+    Error().with(ErrorMessage().fatal().text(e.what())).report(nullptr);
+    std::exit(12);
+}
+
 inline $union execute(VM* vm, Assembly* assembly) try {
-    return call(assembly, vm, assembly->functions.size() - 1, {});
+    auto ret = call(assembly, vm, assembly->functions.size() - 1, {});
+    vm->report(stderr);
+    return ret;
 } catch (Exception& e) {
     fprintf(stderr, "Runtime exception occurred: \n");
     fprintf(stderr, "%s\n", e.what());
+    vm->report(stderr);
     std::exit(1);
 } catch (std::bad_alloc& e) {
     fprintf(stderr, "Runtime out of memory\n");
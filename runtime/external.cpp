@@ -6,11 +6,16 @@
 namespace Porkchop::Externals {
 
 const std::string& as_string($union value) {
-    return dynamic_cast<String*>(value.$object)->value;
+    return dynamic_cast<String*>(value.$object)->value();
+}
+
+std::string_view as_view($union value) {
+    return dynamic_cast<String*>(value.$object)->view();
 }
 
 $union print(VM* vm, const std::vector<$union> &args) {
-    fputs(as_string(args[0]).c_str(), vm->out);
+    auto string = as_view(args[0]);
+    fwrite(string.data(), 1, string.size(), vm->out);
     return nullptr;
 }
 
@@ -35,6 +40,7 @@ $union parseFloat(VM* vm, const std::vector<$union> &args) {
 
 $union exit(VM* vm, const std::vector<$union> &args) {
     auto ret = args[0];
+    vm->report(stderr);
     std::exit((int) ret.$int);
 }
 
@@ -83,15 +89,50 @@ $union gc(VM* vm, std::vector<$union> const &args) {
     return nullptr;
 }
 
+$union gcStats(VM* vm, std::vector<$union> const &args) {
+    VM::GCGuard guard{vm};
+    Dict::underlying stats{getIdentityKind(ScalarTypes::STRING)};
+    auto stat = [&](const char* name, size_t value) {
+        stats.emplace(vm->newObject<String>(name)).second = (int64_t) value;
+    };
+    stat("collections", vm->stats.collections);
+    stat("pauseNanos", vm->stats.pauseNanos);
+    stat("bytesAllocated", vm->stats.bytesAllocated);
+    stat("bytesLive", vm->stats.bytesLive);
+    stat("bytesPeak", vm->stats.bytesPeak);
+    return vm->newObject<Dict>(std::move(stats), std::make_shared<DictType>(ScalarTypes::STRING, ScalarTypes::INT));
+}
+
+$union heapDump(VM* vm, std::vector<$union> const &args) {
+    FILE* file;
+    if (vm->disableIO || !(file = fopen(as_string(args[0]).c_str(), "w"))) {
+        throw Exception("failed to open heap dump file");
+    }
+    vm->heapDump(file);
+    fclose(file);
+    return nullptr;
+}
+
+$union weakDict(VM* vm, std::vector<$union> const &args) {
+    auto dict = dynamic_cast<Dict*>(args[0].$object);
+    if (!dict) {
+        throw Exception("a dict is expected to make weak");
+    }
+    if (isValueBased(dict->prototype->V)) {
+        throw Exception("values of a weak dict must be objects");
+    }
+    return vm->newObject<WeakDict>(dict->elements, dict->prototype);
+}
+
 $union toBytes(VM* vm, std::vector<$union> const &args) {
-    auto& string = as_string(args[0]);
+    auto string = as_view(args[0]);
     std::vector<uint8_t> bytes(string.begin(), string.end());
     return vm->newObject<ByteList>(std::move(bytes));
 }
 
 $union toChars(VM* vm, std::vector<$union> const &args) {
-    auto& string = as_string(args[0]);
-    std::vector<$union> chars;
+    auto string = as_view(args[0]);
+    std::vector<char32_t> chars;
     chars.reserve(string.length());
     try {
         UnicodeParser parser(string, 0, 0);
@@ -100,25 +141,193 @@ $union toChars(VM* vm, std::vector<$union> const &args) {
         throw Exception("failed to decode Unicode");
     }
     chars.shrink_to_fit();
-    return vm->newObject<ScalarList>(std::move(chars), ScalarTypeKind::CHAR);
+    return vm->newObject<CharList>(std::move(chars));
 }
 
 $union fromBytes(VM* vm, std::vector<$union> const &args) {
-    auto list = dynamic_cast<ByteList*>(args[0].$object);
-    std::string string{list->elements.begin(), list->elements.end()};
+    auto list = dynamic_cast<List*>(args[0].$object);
+    if (auto bytes = dynamic_cast<ByteList*>(list)) {
+        std::string string{bytes->elements.begin(), bytes->elements.end()};
+        return vm->newObject<String>(std::move(string));
+    }
+    std::string string;
+    string.reserve(list->size());
+    for (size_t i = 0; i < list->size(); ++i) {
+        string += char(list->load(i).$byte);
+    }
     return vm->newObject<String>(std::move(string));
 }
 
 $union fromChars(VM* vm, std::vector<$union> const &args) {
-    auto list = dynamic_cast<ScalarList*>(args[0].$object);
+    auto list = dynamic_cast<List*>(args[0].$object);
     std::string string;
-    string.reserve(list->elements.size());
-    for (auto element : list->elements) {
-        string += encodeUnicode(element.$char);
+    string.reserve(list->size());
+    if (auto chars = dynamic_cast<CharList*>(list)) {
+        for (auto element : chars->elements) {
+            string += encodeUnicode(element);
+        }
+    } else {
+        for (size_t i = 0; i < list->size(); ++i) {
+            string += encodeUnicode(list->load(i).$char);
+        }
     }
     return vm->newObject<String>(std::move(string));
 }
 
+String* slice(VM* vm, String* string, size_t offset, size_t length) {
+    if (length >= String::VIEW_THRESHOLD) {
+        return vm->newObject<String>(string, offset, length);
+    }
+    return vm->newObject<String>(std::string(string->view().substr(offset, length)));
+}
+
+$union substring(VM* vm, std::vector<$union> const &args) {
+    auto string = dynamic_cast<String*>(args[0].$object);
+    auto first = args[1].$int;
+    auto last = args[2].$int;
+    if (first < 0 || last < first || last > (int64_t) string->size()) {
+        throw Exception("substring out of bound");
+    }
+    return slice(vm, string, first, last - first);
+}
+
+$union find(VM* vm, std::vector<$union> const &args) {
+    auto string = as_view(args[0]);
+    auto pattern = as_view(args[1]);
+    auto from = args[2].$int;
+    if (from < 0 || from > (int64_t) string.size()) {
+        throw Exception("index out of bound");
+    }
+    auto index = string.find(pattern, from);
+    return index == std::string_view::npos ? (int64_t) -1 : (int64_t) index;
+}
+
+$union split(VM* vm, std::vector<$union> const &args) {
+    auto string = dynamic_cast<String*>(args[0].$object);
+    auto separator = as_view(args[1]);
+    if (separator.empty()) {
+        throw Exception("separator must not be empty");
+    }
+    VM::GCGuard guard{vm};
+    auto view = string->view();
+    std::vector<$union> pieces;
+    for (size_t first = 0;;) {
+        auto last = view.find(separator, first);
+        if (last == std::string_view::npos) {
+            pieces.emplace_back(slice(vm, string, first, view.size() - first));
+            break;
+        }
+        pieces.emplace_back(slice(vm, string, first, last - first));
+        first = last + separator.size();
+    }
+    return vm->newObject<ObjectList>(std::move(pieces), std::make_shared<ListType>(ScalarTypes::STRING));
+}
+
+Iterator* as_iterator(VM* vm, $union value) {
+    auto iterable = dynamic_cast<Iterable*>(value.$object);
+    if (!iterable) {
+        throw Exception("an iterable is expected");
+    }
+    return iterable->iterator(vm);
+}
+
+// a function left with exactly one parameter, which accepts elements of type E
+Func* as_unary(Iterator* source, $union value) {
+    auto func = dynamic_cast<Func*>(value.$object);
+    if (!func || func->prototype->P.size() != 1 || !func->prototype->P.front()->assignableFrom(source->E)) {
+        throw Exception("a function accepting " + source->E->toString() + " is expected");
+    }
+    return func;
+}
+
+$union range(VM* vm, std::vector<$union> const &args) {
+    if (args[2].$int == 0) {
+        throw Exception("step of range must not be zero");
+    }
+    return vm->newObject<RangeIterator>(args[0].$int, args[1].$int, args[2].$int);
+}
+
+$union map(VM* vm, Assembly* assembly, std::vector<$union> const &args) {
+    VM::GCGuard guard{vm};
+    auto source = as_iterator(vm, args[0]);
+    auto func = as_unary(source, args[1]);
+    return vm->newObject<MapIterator>(vm, assembly, source, func);
+}
+
+$union filter(VM* vm, Assembly* assembly, std::vector<$union> const &args) {
+    VM::GCGuard guard{vm};
+    auto source = as_iterator(vm, args[0]);
+    auto func = as_unary(source, args[1]);
+    if (!ScalarTypes::BOOL->equals(func->prototype->R)) {
+        throw Exception("a predicate returning bool is expected");
+    }
+    return vm->newObject<FilterIterator>(vm, assembly, source, func);
+}
+
+$union take(VM* vm, std::vector<$union> const &args) {
+    VM::GCGuard guard{vm};
+    return vm->newObject<TakeIterator>(as_iterator(vm, args[0]), args[1].$int);
+}
+
+$union skip(VM* vm, std::vector<$union> const &args) {
+    VM::GCGuard guard{vm};
+    return vm->newObject<SkipIterator>(as_iterator(vm, args[0]), args[1].$int);
+}
+
+$union zip(VM* vm, std::vector<$union> const &args) {
+    VM::GCGuard guard{vm};
+    return vm->newObject<ZipIterator>(vm, as_iterator(vm, args[0]), as_iterator(vm, args[1]));
+}
+
+$union enumerate(VM* vm, std::vector<$union> const &args) {
+    VM::GCGuard guard{vm};
+    return vm->newObject<EnumerateIterator>(vm, as_iterator(vm, args[0]));
+}
+
+$union chain(VM* vm, std::vector<$union> const &args) {
+    VM::GCGuard guard{vm};
+    auto first = as_iterator(vm, args[0]), second = as_iterator(vm, args[1]);
+    if (!first->E->equals(second->E)) {
+        throw Exception("cannot chain iterators of " + first->E->toString() + " and " + second->E->toString());
+    }
+    return vm->newObject<ChainIterator>(first, second);
+}
+
+$union persistent(VM* vm, std::vector<$union> const &args) {
+    auto object = args[0].$object;
+    if (auto list = dynamic_cast<PersistentList*>(object)) {
+        return vm->newObject<PersistentList>(list->elements, list->prototype);
+    }
+    if (auto dict = dynamic_cast<PersistentDict*>(object)) {
+        return vm->newObject<PersistentDict>(dict->elements, dict->prototype);
+    }
+    if (auto list = dynamic_cast<List*>(object)) {
+        auto type = std::dynamic_pointer_cast<ListType>(list->getType());
+        auto mask = PersistentList::maskOf(type->E);
+        PersistentVector elements;
+        for (size_t i = 0, n = list->size(); i < n; ++i) {
+            elements.push(list->load(i).$size & mask);
+        }
+        return vm->newObject<PersistentList>(std::move(elements), std::move(type));
+    }
+    if (auto dict = dynamic_cast<Dict*>(object)) {
+        PersistentMap elements{getIdentityKind(dict->prototype->K)};
+        for (auto&& [key, value] : dict->elements) {
+            elements.assign(key, value);
+        }
+        return vm->newObject<PersistentDict>(std::move(elements), dict->prototype);
+    }
+    throw Exception("a list or a dict is expected to make persistent");
+}
+
+$union snapshot(VM* vm, std::vector<$union> const &args) {
+    auto object = args[0].$object;
+    if (!dynamic_cast<PersistentList*>(object) && !dynamic_cast<PersistentDict*>(object)) {
+        throw Exception("a persistent list or dict is expected to snapshot");
+    }
+    return persistent(vm, args);
+}
+
 $union eval(VM* vm, std::vector<$union> const &args) {
     throw Exception("use interpreter instead of runtime for implementation of eval()");
 }
@@ -9,6 +9,7 @@
 namespace Porkchop {
 
 struct VM;
+struct Assembly;
 
 using ExternalFunction = std::function<$union(VM*, std::vector<$union> const &)>;
 
@@ -29,10 +30,26 @@ $union flush(VM* vm, std::vector<$union> const &args);
 $union eof(VM* vm, std::vector<$union> const &args);
 $union typename_(VM* vm, std::vector<$union> const &args);
 $union gc(VM* vm, std::vector<$union> const &args);
+$union gcStats(VM* vm, std::vector<$union> const &args);
+$union heapDump(VM* vm, std::vector<$union> const &args);
+$union weakDict(VM* vm, std::vector<$union> const &args);
 $union toBytes(VM* vm, std::vector<$union> const &args);
 $union toChars(VM* vm, std::vector<$union> const &args);
 $union fromBytes(VM* vm, std::vector<$union> const &args);
 $union fromChars(VM* vm, std::vector<$union> const &args);
+$union substring(VM* vm, std::vector<$union> const &args);
+$union find(VM* vm, std::vector<$union> const &args);
+$union split(VM* vm, std::vector<$union> const &args);
+$union range(VM* vm, std::vector<$union> const &args);
+$union map(VM* vm, Assembly* assembly, std::vector<$union> const &args);
+$union filter(VM* vm, Assembly* assembly, std::vector<$union> const &args);
+$union take(VM* vm, std::vector<$union> const &args);
+$union skip(VM* vm, std::vector<$union> const &args);
+$union zip(VM* vm, std::vector<$union> const &args);
+$union enumerate(VM* vm, std::vector<$union> const &args);
+$union chain(VM* vm, std::vector<$union> const &args);
+$union persistent(VM* vm, std::vector<$union> const &args);
+$union snapshot(VM* vm, std::vector<$union> const &args);
 $union eval(VM* vm, std::vector<$union> const &args);
 
 }
@@ -142,7 +142,7 @@ struct Frame {
     }
 
     void sconst(size_t index) {
-        push(assembly->table[index]);
+        push(assembly->constant(vm, index));
     }
 
     void fconst(size_t index) {
@@ -184,7 +184,7 @@ struct Frame {
         auto list = dynamic_cast<List*>(opop());
         if (index < 0 || index >= list->size())
             throw Exception("index out of bound");
-        push(list->load(index), dynamic_cast<ObjectList*>(list));
+        push(list->load(index), list->holdsObjects());
     }
 
     void lstore() {
@@ -198,27 +198,43 @@ struct Frame {
 
     void dload() {
         auto key = pop();
-        auto dict = dynamic_cast<Dict*>(opop());
-        if (!dict->elements.contains(key))
+        auto object = opop();
+        if (auto dict = dynamic_cast<Dict*>(object)) {
+            auto slot = dict->elements.find(key);
+            if (!slot)
+                throw Exception("missing such a key");
+            push(slot->second, !isValueBased(dict->prototype->V));
+            return;
+        }
+        auto dict = dynamic_cast<PersistentDict*>(object);
+        auto value = dict->elements.find(key);
+        if (!value)
             throw Exception("missing such a key");
-        push(dict->elements.at(key), !isValueBased(dict->prototype->V));
+        push(*value, !isValueBased(dict->prototype->V));
     }
 
     void dstore() {
         auto key = pop();
-        auto dict = dynamic_cast<Dict*>(opop());
+        auto object = opop();
         auto value = top();
-        dict->elements.insert_or_assign(key, value);
+        auto bytes = object->bytes();
+        if (auto dict = dynamic_cast<Dict*>(object)) {
+            dict->elements.emplace(key).second = value;
+        } else {
+            dynamic_cast<PersistentDict*>(object)->elements.assign(key, value);
+        }
+        VM::ObjectHolder holder(vm, object);
+        vm->grow(bytes, object->bytes());
     }
 
     void call() {
-        VM::ObjectHolder object = opop();
+        VM::ObjectHolder object(vm, opop());
         auto func = object.as<Func>();
         push(func->call(assembly, vm), !isValueBased(func->prototype->R));
     }
 
     void bind(size_t size) {
-        VM::ObjectHolder object = opop();
+        VM::ObjectHolder object(vm, opop());
         auto func = object.as<Func>();
         auto captures = npop(size);
         // optimization: merge bind call
@@ -229,12 +245,17 @@ struct Frame {
             push(Porkchop::call(assembly, vm, func->func, std::move(captures0)), !isValueBased(func->prototype->R));
             return;
         }
+        vm->reserve(sizeof(Func) + (func->captures.size() + captures.size()) * sizeof($union));
         VM::GCGuard guard{vm};
-        push(func->bind(std::move(captures)));
+        push(func->bind(vm, std::move(captures)));
     }
 
     void as(TypeReference const& type) {
         auto object = opop();
+        if (auto scalar = dynamic_cast<AnyScalar*>(object); scalar && isScalar(type, scalar->type)) {
+            const_(scalar->value);
+            return;
+        }
         auto type0 = object->getType();
         if (!type->assignableFrom(type0)) {
             throw Exception("cannot cast " + type0->toString() + " to " + type->toString());
@@ -247,11 +268,16 @@ struct Frame {
     }
 
     void is(TypeReference const& type) {
-        push(opop()->getType()->equals(type));
+        auto object = opop();
+        if (auto scalar = dynamic_cast<AnyScalar*>(object)) {
+            push(isScalar(type, scalar->type));
+        } else {
+            push(object->getType()->equals(type));
+        }
     }
 
     void any(TypeReference const& type) {
-        push(vm->newObject<AnyScalar>(pop(), dynamic_cast<ScalarType*>(type.get())->S));
+        push(vm->box(pop(), dynamic_cast<ScalarType*>(type.get())->S));
     }
 
     void i2b() {
@@ -277,8 +303,10 @@ struct Frame {
     }
 
     void tuple(TypeReference const& prototype) {
-        VM::GCGuard guard{vm};
         auto tuple = std::dynamic_pointer_cast<TupleType>(prototype);
+        // no collection may happen under the guard, so it happens before while the elements are still on the stack
+        vm->reserve(sizeof(More) + tuple->E.size() * sizeof($union));
+        VM::GCGuard guard{vm};
         auto elements = npop(tuple->E.size());
         if (elements.size() == 2) {
             push(vm->newObject<Pair>(elements.front(), elements.back(), tuple->E.front(), tuple->E.back()));
@@ -287,11 +315,21 @@ struct Frame {
         }
     }
 
+    template<typename T>
+    void scalarList(std::vector<$union> const& elements) {
+        std::vector<T> elements0(elements.size());
+        for (size_t i = 0; i < elements.size(); ++i) {
+            elements0[i] = ScalarList<T>::unwrap(elements[i]);
+        }
+        push(vm->newObject<ScalarList<T>>(std::move(elements0)));
+    }
+
     void list(std::pair<TypeReference, size_t> const& cons) {
+        vm->reserve(sizeof(ObjectList) + cons.second * sizeof($union));
         auto elements = npop(cons.second);
         auto list = dynamic_pointer_cast<ListType>(cons.first);
         if (isValueBased(list->E)) {
-            switch (auto type = dynamic_cast<ScalarType*>(list->E.get())->S) {
+            switch (dynamic_cast<ScalarType*>(list->E.get())->S) {
                 case ScalarTypeKind::NONE:
                     push(vm->newObject<NoneList>(elements.size()));
                     break;
@@ -311,9 +349,17 @@ struct Frame {
                     push(vm->newObject<ByteList>(std::move(elements0)));
                     break;
                 }
-                default:
-                    push(vm->newObject<ScalarList>(std::move(elements), type));
+                case ScalarTypeKind::INT:
+                    scalarList<int64_t>(elements);
+                    break;
+                case ScalarTypeKind::FLOAT:
+                    scalarList<double>(elements);
                     break;
+                case ScalarTypeKind::CHAR:
+                    scalarList<char32_t>(elements);
+                    break;
+                default:
+                    unreachable();
             }
         } else {
             VM::GCGuard guard{vm};
@@ -322,6 +368,7 @@ struct Frame {
     }
 
     void set(std::pair<TypeReference, size_t> const& cons) {
+        vm->reserve(sizeof(Set) + Set::underlying::fit(cons.second) * (1 + sizeof($union)));
         VM::GCGuard guard{vm};
         auto elements = npop(cons.second);
         auto type = std::dynamic_pointer_cast<SetType>(cons.first);
@@ -347,19 +394,22 @@ struct Frame {
                 }
             }
         }
-        auto kind = getIdentityKind(type->E);
-        Set::underlying set(elements.begin(), elements.end(), 0, Hasher{kind}, Equator{kind});
+        Set::underlying set{getIdentityKind(type->E)};
+        set.reserve(elements.size());
+        for (auto&& element : elements)
+            set.emplace(element);
         push(vm->newObject<Set>(std::move(set), std::move(type)));
     }
 
     void dict(std::pair<TypeReference, size_t> const& cons) {
+        vm->reserve(sizeof(Dict) + Dict::underlying::fit(cons.second) * (1 + 2 * sizeof($union)));
         VM::GCGuard guard{vm};
         auto elements = npop(cons.second * 2);
         auto type = std::dynamic_pointer_cast<DictType>(cons.first);
-        auto kind = getIdentityKind(type->K);
-        Dict::underlying map{0, Hasher{kind}, Equator{kind}};
+        Dict::underlying map{getIdentityKind(type->K)};
+        map.reserve(cons.second);
         for (size_t i = 0; i < cons.second; ++i) {
-            map.insert_or_assign(elements[2 * i], elements[2 * i + 1]);
+            map.emplace(elements[2 * i]).second = elements[2 * i + 1];
         }
         push(vm->newObject<Dict>(std::move(map), std::move(type)));
     }
@@ -452,7 +502,7 @@ struct Frame {
     void scmp(size_t cmp) {
         auto value2 = spop();
         auto value1 = spop();
-        compare(value1->value <=> value2->value, cmp);
+        compare(value1->view() <=> value2->view(), cmp);
     }
 
     void ocmp(size_t cmp) {
@@ -461,10 +511,30 @@ struct Frame {
         compare(value1->equals(value2) ? std::partial_ordering::equivalent : std::partial_ordering::unordered, cmp);
     }
 
+    // Checks that joining the top size strings stays under the heap limit, before they are popped.
+    // Each part may cost a rope node and a flat string besides its contents, whose buffer may grow to twice as long.
+    void reserveStrings(size_t size) {
+        if (!vm->heapLimit) return;
+        size_t bytes = 0;
+        for (auto it = stack.end() - (ptrdiff_t) size; it != stack.end(); ++it) {
+            bytes += 2 * (sizeof(String) + dynamic_cast<String*>(it->$object)->size());
+        }
+        vm->reserve(bytes);
+    }
+
     void sadd() {
+        reserveStrings(2);
         auto value2 = spop();
         auto value1 = spop();
-        push(value1->value + value2->value);
+        if (value1->size() + value2->size() >= String::ROPE_THRESHOLD) {
+            push(vm->newObject<String>(value1, value2));
+        } else {
+            std::string buf;
+            buf.reserve(value1->size() + value2->size());
+            buf += value1->view();
+            buf += value2->view();
+            push(vm->newObject<String>(std::move(buf)));
+        }
     }
 
     void iadd() {
@@ -540,17 +610,45 @@ struct Frame {
     }
 
     void iter() {
-        VM::ObjectHolder object = opop();
-        push(object.as<Iterable>()->iterator());
+        VM::ObjectHolder object(vm, opop());
+        push(object.as<Iterable>()->iterator(vm));
     }
 
     void move() {
-        VM::ObjectHolder object = opop();
+        VM::ObjectHolder object(vm, opop());
         push(object.as<Iterator>()->move());
     }
 
+    // the JMP0 following a stepping instruction is taken once there is nothing left
+    void step(bool more) {
+        if (more) {
+            ++pc;
+        } else {
+            pc = std::get<size_t>(instructions->operator[](pc + 1).second) - 1;
+        }
+    }
+
+    void next(size_t index) {
+        auto iter = static_cast<Iterator*>(stack[index].$object);
+        bool more = iter->move();
+        if (more) stack[index + 1] = iter->get();
+        step(more);
+    }
+
+    void lnext(size_t index) {
+        auto list = static_cast<List*>(stack[index].$object);
+        step(list->next(stack[index + 1].$size, stack[index + 2]));
+    }
+
+    void dnext(size_t index) {
+        auto iter = static_cast<EntryIterator*>(stack[index].$object);
+        bool more = iter->advance();
+        if (more) std::tie(stack[index + 1], stack[index + 2]) = iter->entry();
+        step(more);
+    }
+
     void get() {
-        VM::ObjectHolder object = opop();
+        VM::ObjectHolder object(vm, opop());
         auto iter = object.as<Iterator>();
         push(iter->get(), !isValueBased(iter->E));
     }
@@ -593,8 +691,10 @@ struct Frame {
     void add() {
         auto value = pop();
         auto collection = dynamic_cast<Collection*>(opop());
+        auto bytes = collection->bytes();
         collection->add(value);
         push(collection);
+        vm->grow(bytes, collection->bytes());
     }
 
     void remove() {
@@ -615,8 +715,12 @@ struct Frame {
         push((int64_t) sizeable->size());
     }
 
+    void ihash() {
+        push((int64_t) Hash::scalar(pop().$size));
+    }
+
     void fhash() {
-        push((int64_t) std::hash<double>()(fpop()));
+        push((int64_t) Hash::floating(fpop()));
     }
 
     void ohash() {
@@ -624,12 +728,30 @@ struct Frame {
     }
 
     void sjoin(size_t size) {
+        reserveStrings(size);
+        VM::GCGuard guard{vm};
         auto strings = npop(size);
+        // long parts are linked into a rope, while runs of short parts are copied together
+        String* rope = nullptr;
         std::string buf;
+        auto append = [&](String* piece) {
+            rope = rope ? vm->newObject<String>(rope, piece) : piece;
+        };
         for (auto&& string : strings) {
-            buf += dynamic_cast<String*>(string.$object)->value;
+            auto piece = dynamic_cast<String*>(string.$object);
+            if (piece->size() >= String::ROPE_THRESHOLD) {
+                if (!buf.empty()) append(vm->newObject<String>(std::exchange(buf, {})));
+                append(piece);
+            } else {
+                buf += piece->view();
+            }
         }
-        push(vm->newObject<String>(std::move(buf)));
+        if (!rope) {
+            push(vm->newObject<String>(std::move(buf)));
+            return;
+        }
+        if (!buf.empty()) append(vm->newObject<String>(std::move(buf)));
+        push(rope);
     }
 
     $union yield() {
@@ -831,6 +953,15 @@ struct Frame {
                 case Opcode::GET:
                     get();
                     break;
+                case Opcode::NEXT:
+                    next(std::get<size_t>(args));
+                    break;
+                case Opcode::LNEXT:
+                    lnext(std::get<size_t>(args));
+                    break;
+                case Opcode::DNEXT:
+                    dnext(std::get<size_t>(args));
+                    break;
                 case Opcode::I2S:
                     i2s();
                     break;
@@ -861,6 +992,9 @@ struct Frame {
                 case Opcode::SIZEOF:
                     sizeof_();
                     break;
+                case Opcode::IHASH:
+                    ihash();
+                    break;
                 case Opcode::FHASH:
                     fhash();
                     break;
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+
+#include "../type.hpp"
+
+namespace Porkchop {
+
+// wyhash-style mixing, folding a 64x64->128 bit product back into 64 bits
+namespace Hash {
+
+constexpr size_t P0 = 0xa0761d6478bd642full;
+constexpr size_t P1 = 0xe7037ed1a0b428dbull;
+constexpr size_t P2 = 0x8ebc6af09c88c6e3ull;
+constexpr size_t P3 = 0x589965cc75374cc3ull;
+
+inline size_t mix(size_t a, size_t b) noexcept {
+    auto product = (unsigned __int128) a * b;
+    return size_t(product) ^ size_t(product >> 64);
+}
+
+// spreads every bit of a scalar over the whole hash
+inline size_t scalar(size_t x) noexcept {
+    auto product = (unsigned __int128) (x ^ P0) * P1;
+    return mix(size_t(product) ^ P0, size_t(product >> 64) ^ P1);
+}
+
+inline size_t floating(double x) noexcept {
+    size_t bits;
+    memcpy(&bits, &x, sizeof bits);
+    return scalar(x == 0 ? 0 : bits); // 0.0 equals -0.0
+}
+
+// order-sensitive combination, so that every element of a sequence counts
+inline size_t combine(size_t seed, size_t hash) noexcept {
+    return mix(seed ^ P2, hash ^ P3);
+}
+
+inline size_t bytes(const void* data, size_t n) noexcept {
+    auto p = static_cast<const uint8_t*>(data);
+    auto read8 = [](const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; };
+    auto read4 = [](const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return uint64_t(v); };
+    size_t seed = mix(P0, P1), a, b;
+    if (n <= 16) {
+        if (n >= 4) {
+            a = read4(p) << 32 | read4(p + (n >> 3 << 2));
+            b = read4(p + n - 4) << 32 | read4(p + n - 4 - (n >> 3 << 2));
+        } else if (n > 0) {
+            a = size_t(p[0]) << 16 | size_t(p[n >> 1]) << 8 | p[n - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = n;
+        if (i > 48) {
+            size_t seed1 = seed, seed2 = seed;
+            do {
+                seed = mix(read8(p) ^ P1, read8(p + 8) ^ seed);
+                seed1 = mix(read8(p + 16) ^ P2, read8(p + 24) ^ seed1);
+                seed2 = mix(read8(p + 32) ^ P3, read8(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        for (; i > 16; i -= 16, p += 16) {
+            seed = mix(read8(p) ^ P1, read8(p + 8) ^ seed);
+        }
+        a = read8(p + i - 16);
+        b = read8(p + i - 8);
+    }
+    auto product = (unsigned __int128) (a ^ P1) * (b ^ seed);
+    return mix(size_t(product) ^ P0 ^ n, size_t(product >> 64) ^ P1);
+}
+
+}
+
+// hashing and equality of a single identity kind, resolved at compile time
+template<IdentityKind K>
+struct Identity;
+
+template<>
+struct Identity<IdentityKind::SELF> {
+    static size_t hash($union u) noexcept { return Hash::scalar(u.$size); }
+    static bool equals($union u, $union v) noexcept { return u.$size == v.$size; }
+};
+
+template<>
+struct Identity<IdentityKind::FLOAT> {
+    static size_t hash($union u) noexcept { return Hash::floating(u.$float); }
+    static bool equals($union u, $union v) noexcept { return u.$float == v.$float; }
+};
+
+template<>
+struct Identity<IdentityKind::OBJECT> {
+    static size_t hash($union u);
+    static bool equals($union u, $union v);
+};
+
+}
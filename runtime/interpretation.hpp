@@ -10,12 +10,13 @@ namespace Porkchop {
 struct Interpretation : Assembler, Assembly {
     Instructions instructions;
     std::unordered_map<size_t, size_t> labels;
+    std::vector<std::pair<size_t, size_t>> marks;
 
     explicit Interpretation(Continuum* continuum) {
         functions.back() = [continuum, this](VM* vm, std::vector<$union> const &args) -> $union {
             Source source;
             try {
-                source.append(dynamic_cast<String*>(args[1].$object)->value);
+                source.append(dynamic_cast<String*>(args[1].$object)->value());
             } catch (Error& e) {
                 e.report(&source);
                 throw Exception("failed to compile script in eval");
@@ -31,7 +32,7 @@ struct Interpretation : Assembler, Assembly {
             auto type = continuum->functions.back()->prototype()->R;
             auto ret = Porkchop::call(this, vm, functions.size() - 1, {args[0]});
             if (isValueBased(type))
-                ret = vm->newObject<AnyScalar>(ret, dynamic_cast<ScalarType*>(type.get())->S);
+                ret = vm->box(ret, dynamic_cast<ScalarType*>(type.get())->S);
             return ret;
         };
     }
@@ -76,8 +77,17 @@ struct Interpretation : Assembler, Assembly {
         prototypes.push_back(std::dynamic_pointer_cast<FuncType>(type));
     }
 
+    void line(size_t line) override {
+        if (!marks.empty() && marks.back().first == instructions.size()) {
+            marks.back().second = line;
+        } else {
+            marks.emplace_back(instructions.size(), line);
+        }
+    }
+
     void beginFunction() override {
         instructions.clear();
+        marks.clear();
     }
 
     void processLabels() {
@@ -91,6 +101,8 @@ struct Interpretation : Assembler, Assembly {
 
     void endFunction() override {
         processLabels();
+        lines.resize(functions.size());
+        lines.emplace_back(std::move(marks));
         functions.emplace_back(std::move(instructions));
     }
 
@@ -4,6 +4,8 @@
 
 int main(int argc, const char* argv[]) {
     Porkchop::forceUTF8();
+    Porkchop::VM vm;
+    Porkchop::configure(vm, argc, argv);
     const int argi = 2;
     if (argc < argi) {
         Porkchop::Error error;
@@ -20,7 +22,6 @@ int main(int argc, const char* argv[]) {
     Porkchop::parse(compiler);
     Porkchop::Interpretation interpretation(&continuum);
     compiler.compile(&interpretation);
-    Porkchop::VM vm;
     vm.init(argi, argc, argv);
     return (int) Porkchop::execute(&vm, &interpretation).$int;
 }
@@ -5,6 +5,8 @@
 
 int main(int argc, const char* argv[]) {
     Porkchop::forceUTF8();
+    Porkchop::VM vm;
+    Porkchop::configure(vm, argc, argv);
     const int argi = 3;
     if (argc < argi) {
         Porkchop::Error error;
@@ -34,7 +36,6 @@ int main(int argc, const char* argv[]) {
     } else {
         assembly = std::make_unique<Porkchop::BinAssembly>(Porkchop::readBin(input_file));
     }
-    Porkchop::VM vm;
     vm.init(argi, argc, argv);
     return (int) Porkchop::execute(&vm, assembly.get()).$int;
 }
\ No newline at end of file
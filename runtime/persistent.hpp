@@ -0,0 +1,374 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <bit>
+#include <algorithm>
+#include <utility>
+
+#include "hash.hpp"
+#include "../util.hpp"
+
+namespace Porkchop {
+
+namespace Trie {
+
+constexpr size_t BITS = 5;
+constexpr size_t WIDTH = 1 << BITS;
+constexpr size_t MASK = WIDTH - 1;
+
+// Nodes are shared by every version of a collection that has not changed them since.
+// A node is modified in place only while no one else holds it, and is copied first otherwise.
+// Copying a node takes another hold of each of its children, so the whole path below gets copied as well.
+template<typename Node>
+Node& own(std::shared_ptr<Node>& node) {
+    if (node.use_count() != 1) node = std::make_shared<Node>(*node);
+    return *node;
+}
+
+}
+
+// A vector of WIDTH-way trie nodes, whose last few elements are kept in a tail out of the trie.
+// Copying it costs O(1), while an update copies only the O(log n) nodes on the path to the element.
+struct PersistentVector {
+    struct Node {
+        std::vector<std::shared_ptr<Node>> children;
+        std::vector<$union> values;
+    };
+
+private:
+    std::shared_ptr<Node> root = std::make_shared<Node>(), tail = std::make_shared<Node>();
+    size_t count = 0, shift = Trie::BITS;
+
+public:
+    [[nodiscard]] size_t size() const noexcept { return count; }
+
+    // whether both are the same version, so that they hold exactly the same elements
+    [[nodiscard]] bool shares(PersistentVector const& other) const noexcept {
+        return root == other.root && tail == other.tail;
+    }
+
+    // the leaf holding the element at the index, where it is found at index & MASK
+    [[nodiscard]] const $union* leaf(size_t index) const noexcept {
+        return leafNode(index)->values.data();
+    }
+
+    $union operator[](size_t index) const noexcept {
+        return leaf(index)[index & Trie::MASK];
+    }
+
+    void set(size_t index, $union value) {
+        if (index >= tailOffset()) {
+            Trie::own(tail).values[index & Trie::MASK] = value;
+            return;
+        }
+        Node* node = &Trie::own(root);
+        for (size_t level = shift; level > 0; level -= Trie::BITS)
+            node = &Trie::own(node->children[(index >> level) & Trie::MASK]);
+        node->values[index & Trie::MASK] = value;
+    }
+
+    void push($union value) {
+        if (count - tailOffset() < Trie::WIDTH) {
+            Trie::own(tail).values.push_back(value);
+        } else {
+            // the full tail moves into the trie, which grows by a level once its root is full
+            if ((count >> Trie::BITS) > (size_t(1) << shift)) {
+                auto node = std::make_shared<Node>();
+                node->children.push_back(std::move(root));
+                node->children.push_back(path(shift, std::move(tail)));
+                root = std::move(node);
+                shift += Trie::BITS;
+            } else {
+                pushTail(root, shift, std::move(tail));
+            }
+            tail = std::make_shared<Node>();
+            tail->values.push_back(value);
+        }
+        ++count;
+    }
+
+    void pop() {
+        if (count == 1) {
+            *this = {};
+            return;
+        }
+        if (count - tailOffset() > 1) {
+            Trie::own(tail).values.pop_back();
+        } else {
+            // the tail is used up, so the last leaf of the trie takes its place
+            auto last = leafNode(count - 2);
+            if (popTail(root, shift)) root = std::make_shared<Node>();
+            if (shift > Trie::BITS && root->children.size() == 1) {
+                root = root->children.front();
+                shift -= Trie::BITS;
+            }
+            tail = std::move(last);
+        }
+        --count;
+    }
+
+    // pops down to the index and pushes the rest back, so erasing near the end is cheap
+    void erase(size_t index) {
+        std::vector<$union> rest;
+        rest.reserve(count - index - 1);
+        for (size_t i = index + 1; i < count; ++i) rest.push_back((*this)[i]);
+        while (count > index) pop();
+        for (auto value : rest) push(value);
+    }
+
+    template<typename F>
+    void forEach(F&& f) const {
+        for (size_t i = 0; i < count; i += Trie::WIDTH) {
+            auto values = leaf(i);
+            for (size_t j = 0, n = std::min(Trie::WIDTH, count - i); j < n; ++j) f(values[j]);
+        }
+    }
+
+private:
+    [[nodiscard]] size_t tailOffset() const noexcept {
+        return count < Trie::WIDTH ? 0 : (count - 1) >> Trie::BITS << Trie::BITS;
+    }
+
+    [[nodiscard]] std::shared_ptr<Node> const& leafNode(size_t index) const noexcept {
+        if (index >= tailOffset()) return tail;
+        auto node = &root;
+        for (size_t level = shift; level > 0; level -= Trie::BITS)
+            node = &(*node)->children[(index >> level) & Trie::MASK];
+        return *node;
+    }
+
+    static std::shared_ptr<Node> path(size_t level, std::shared_ptr<Node> leaf) {
+        for (; level > 0; level -= Trie::BITS) {
+            auto node = std::make_shared<Node>();
+            node->children.push_back(std::move(leaf));
+            leaf = std::move(node);
+        }
+        return leaf;
+    }
+
+    void pushTail(std::shared_ptr<Node>& parent, size_t level, std::shared_ptr<Node> leaf) {
+        auto& node = Trie::own(parent);
+        size_t index = ((count - 1) >> level) & Trie::MASK;
+        if (level == Trie::BITS) {
+            node.children.push_back(std::move(leaf));
+        } else if (index < node.children.size()) {
+            pushTail(node.children[index], level - Trie::BITS, std::move(leaf));
+        } else {
+            node.children.push_back(path(level - Trie::BITS, std::move(leaf)));
+        }
+    }
+
+    // drops the last leaf under the node, telling whether the node is left empty
+    bool popTail(std::shared_ptr<Node>& parent, size_t level) {
+        auto& node = Trie::own(parent);
+        size_t index = ((count - 2) >> level) & Trie::MASK;
+        if (level > Trie::BITS && !popTail(node.children[index], level - Trie::BITS)) return false;
+        node.children.pop_back();
+        return index == 0;
+    }
+};
+
+// A hash array mapped trie, each node of which branches on the next BITS of the hash
+// and keeps its present branches densely in the order of a bitmap.
+// Keys whose hashes collide entirely end up in a bucket past the last level, searched linearly.
+struct PersistentMap {
+    IdentityKind kind;
+
+    struct Node;
+
+    struct Entry {
+        size_t hash;
+        $union key, value;
+        std::shared_ptr<Node> child; // a branch in place of a key and a value if set
+    };
+
+    struct Node {
+        uint32_t bitmap = 0;
+        std::vector<Entry> entries;
+    };
+
+    // the entries of a version of the map in the order of their hashes
+    struct Cursor {
+        std::vector<std::pair<const Node*, size_t>> path;
+
+        // the next entry, or nullptr if there is none
+        const Entry* next() noexcept {
+            while (!path.empty()) {
+                auto [node, index] = path.back();
+                if (index == node->entries.size()) {
+                    path.pop_back();
+                    continue;
+                }
+                ++path.back().second;
+                auto& entry = node->entries[index];
+                if (!entry.child) return &entry;
+                path.emplace_back(entry.child.get(), 0);
+            }
+            return nullptr;
+        }
+    };
+
+private:
+    static constexpr size_t BUCKET = 64;
+
+    std::shared_ptr<Node> root = std::make_shared<Node>();
+    size_t count = 0;
+
+    template<typename F>
+    decltype(auto) dispatch(F&& f) const {
+        switch (kind) {
+            case IdentityKind::SELF:
+                return f.template operator()<IdentityKind::SELF>();
+            case IdentityKind::FLOAT:
+                return f.template operator()<IdentityKind::FLOAT>();
+            case IdentityKind::OBJECT:
+                return f.template operator()<IdentityKind::OBJECT>();
+        }
+        unreachable();
+    }
+
+public:
+    explicit PersistentMap(IdentityKind kind) noexcept: kind(kind) {}
+
+    [[nodiscard]] size_t size() const noexcept { return count; }
+
+    [[nodiscard]] bool shares(PersistentMap const& other) const noexcept {
+        return root == other.root;
+    }
+
+    // the cursor must not outlive this version
+    [[nodiscard]] Cursor cursor() const {
+        return {{{root.get(), 0}}};
+    }
+
+    // the value mapped from the key, which must not be modified in place
+    const $union* find($union key) const {
+        return dispatch([&]<IdentityKind K>() { return findAs<K>(key, Identity<K>::hash(key)); });
+    }
+
+    bool contains($union key) const {
+        return find(key) != nullptr;
+    }
+
+    // maps the key to the value, telling whether the key is new
+    bool assign($union key, $union value) {
+        return dispatch([&]<IdentityKind K>() {
+            bool added = assignAs<K>(root, 0, {Identity<K>::hash(key), key, value, nullptr});
+            count += added;
+            return added;
+        });
+    }
+
+    bool erase($union key) {
+        // nothing is copied for a missing key
+        if (!contains(key)) return false;
+        dispatch([&]<IdentityKind K>() { eraseAs<K>(root, 0, Identity<K>::hash(key), key); });
+        --count;
+        return true;
+    }
+
+    template<typename F>
+    void forEach(F&& f) const {
+        forEach(*root, f);
+    }
+
+private:
+    static uint32_t bitOf(size_t hash, size_t shift) noexcept {
+        return uint32_t(1) << ((hash >> shift) & Trie::MASK);
+    }
+
+    static size_t indexOf(Node const& node, uint32_t bit) noexcept {
+        return std::popcount(node.bitmap & (bit - 1));
+    }
+
+    template<IdentityKind K>
+    const $union* findAs($union key, size_t hash) const {
+        const Node* node = root.get();
+        for (size_t shift = 0; shift < BUCKET; shift += Trie::BITS) {
+            uint32_t bit = bitOf(hash, shift);
+            if (!(node->bitmap & bit)) return nullptr;
+            auto& entry = node->entries[indexOf(*node, bit)];
+            if (!entry.child) {
+                return entry.hash == hash && Identity<K>::equals(entry.key, key) ? &entry.value : nullptr;
+            }
+            node = entry.child.get();
+        }
+        for (auto&& entry : node->entries) {
+            if (Identity<K>::equals(entry.key, key)) return &entry.value;
+        }
+        return nullptr;
+    }
+
+    template<IdentityKind K>
+    static bool assignAs(std::shared_ptr<Node>& ref, size_t shift, Entry entry) {
+        auto& node = Trie::own(ref);
+        if (shift >= BUCKET) {
+            for (auto&& present : node.entries) {
+                if (Identity<K>::equals(present.key, entry.key)) {
+                    present.value = entry.value;
+                    return false;
+                }
+            }
+            node.entries.push_back(std::move(entry));
+            return true;
+        }
+        uint32_t bit = bitOf(entry.hash, shift);
+        size_t index = indexOf(node, bit);
+        if (!(node.bitmap & bit)) {
+            node.bitmap |= bit;
+            node.entries.insert(node.entries.begin() + index, std::move(entry));
+            return true;
+        }
+        auto& present = node.entries[index];
+        if (present.child) return assignAs<K>(present.child, shift + Trie::BITS, std::move(entry));
+        if (present.hash == entry.hash && Identity<K>::equals(present.key, entry.key)) {
+            present.value = entry.value;
+            return false;
+        }
+        // two keys meet at the same branch, which then splits on the following bits
+        auto child = std::make_shared<Node>();
+        assignAs<K>(child, shift + Trie::BITS, std::move(present));
+        assignAs<K>(child, shift + Trie::BITS, std::move(entry));
+        present = {};
+        present.child = std::move(child);
+        return true;
+    }
+
+    template<IdentityKind K>
+    static void eraseAs(std::shared_ptr<Node>& ref, size_t shift, size_t hash, $union key) {
+        auto& node = Trie::own(ref);
+        if (shift >= BUCKET) {
+            node.entries.erase(std::find_if(node.entries.begin(), node.entries.end(),
+                                            [key](Entry const& entry) { return Identity<K>::equals(entry.key, key); }));
+            return;
+        }
+        uint32_t bit = bitOf(hash, shift);
+        size_t index = indexOf(node, bit);
+        auto& present = node.entries[index];
+        if (present.child) {
+            eraseAs<K>(present.child, shift + Trie::BITS, hash, key);
+            // a branch left with a single key folds back into its parent
+            if (auto& rest = present.child->entries; rest.size() == 1 && !rest.front().child) {
+                Entry entry = rest.front();
+                present = std::move(entry);
+            }
+            return;
+        }
+        node.entries.erase(node.entries.begin() + index);
+        node.bitmap &= ~bit;
+    }
+
+    template<typename F>
+    static void forEach(Node const& node, F& f) {
+        for (auto&& entry : node.entries) {
+            if (entry.child) {
+                forEach(*entry.child, f);
+            } else {
+                f(entry.key, entry.value);
+            }
+        }
+    }
+};
+
+}
@@ -0,0 +1,207 @@
+#include "search.hpp"
+
+#include <cstring>
+#include <bit>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PORKCHOP_SEARCH_X86
+#endif
+
+namespace Porkchop::Search {
+
+namespace {
+
+size_t findScalar(const int64_t* data, size_t n, int64_t value) noexcept {
+    for (size_t i = 0; i < n; ++i)
+        if (data[i] == value) return i;
+    return n;
+}
+
+size_t findScalar(const double* data, size_t n, double value) noexcept {
+    for (size_t i = 0; i < n; ++i)
+        if (data[i] == value) return i;
+    return n;
+}
+
+size_t findScalar(const char32_t* data, size_t n, char32_t value) noexcept {
+    for (size_t i = 0; i < n; ++i)
+        if (data[i] == value) return i;
+    return n;
+}
+
+bool equalScalar(const double* a, const double* b, size_t n) noexcept {
+    for (size_t i = 0; i < n; ++i)
+        if (a[i] != b[i]) return false;
+    return true;
+}
+
+#ifdef PORKCHOP_SEARCH_X86
+
+__attribute__((target("sse2")))
+size_t findSSE2(const int64_t* data, size_t n, int64_t value) noexcept {
+    const __m128i needle = _mm_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // no 64-bit comparison before SSE4.1, so both 32-bit halves have to match
+        __m128i x = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), needle);
+        __m128i y = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 2)), needle);
+        x = _mm_and_si128(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+        y = _mm_and_si128(y, _mm_shuffle_epi32(y, _MM_SHUFFLE(2, 3, 0, 1)));
+        if (int mask = _mm_movemask_pd(_mm_castsi128_pd(x)) | _mm_movemask_pd(_mm_castsi128_pd(y)) << 2)
+            return i + std::countr_zero(unsigned(mask));
+    }
+    return i + findScalar(data + i, n - i, value);
+}
+
+__attribute__((target("sse2")))
+size_t findSSE2(const double* data, size_t n, double value) noexcept {
+    const __m128d needle = _mm_set1_pd(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128d x = _mm_cmpeq_pd(_mm_loadu_pd(data + i), needle);
+        __m128d y = _mm_cmpeq_pd(_mm_loadu_pd(data + i + 2), needle);
+        if (int mask = _mm_movemask_pd(x) | _mm_movemask_pd(y) << 2)
+            return i + std::countr_zero(unsigned(mask));
+    }
+    return i + findScalar(data + i, n - i, value);
+}
+
+__attribute__((target("sse2")))
+size_t findSSE2(const char32_t* data, size_t n, char32_t value) noexcept {
+    const __m128i needle = _mm_set1_epi32(int(value));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), needle);
+        __m128i y = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 4)), needle);
+        if (int mask = _mm_movemask_ps(_mm_castsi128_ps(x)) | _mm_movemask_ps(_mm_castsi128_ps(y)) << 4)
+            return i + std::countr_zero(unsigned(mask));
+    }
+    return i + findScalar(data + i, n - i, value);
+}
+
+__attribute__((target("sse2")))
+bool equalSSE2(const double* a, const double* b, size_t n) noexcept {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128d x = _mm_cmpeq_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+        __m128d y = _mm_cmpeq_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2));
+        if (_mm_movemask_pd(_mm_and_pd(x, y)) != 0b11) return false;
+    }
+    return equalScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+size_t findAVX2(const int64_t* data, size_t n, int64_t value) noexcept {
+    const __m256i needle = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_cmpeq_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), needle);
+        __m256i y = _mm256_cmpeq_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 4)), needle);
+        if (int mask = _mm256_movemask_pd(_mm256_castsi256_pd(x)) | _mm256_movemask_pd(_mm256_castsi256_pd(y)) << 4)
+            return i + std::countr_zero(unsigned(mask));
+    }
+    return i + findScalar(data + i, n - i, value);
+}
+
+__attribute__((target("avx2")))
+size_t findAVX2(const double* data, size_t n, double value) noexcept {
+    const __m256d needle = _mm256_set1_pd(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d x = _mm256_cmp_pd(_mm256_loadu_pd(data + i), needle, _CMP_EQ_OQ);
+        __m256d y = _mm256_cmp_pd(_mm256_loadu_pd(data + i + 4), needle, _CMP_EQ_OQ);
+        if (int mask = _mm256_movemask_pd(x) | _mm256_movemask_pd(y) << 4)
+            return i + std::countr_zero(unsigned(mask));
+    }
+    return i + findScalar(data + i, n - i, value);
+}
+
+__attribute__((target("avx2")))
+size_t findAVX2(const char32_t* data, size_t n, char32_t value) noexcept {
+    const __m256i needle = _mm256_set1_epi32(int(value));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), needle);
+        __m256i y = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 8)), needle);
+        if (int mask = _mm256_movemask_ps(_mm256_castsi256_ps(x)) | _mm256_movemask_ps(_mm256_castsi256_ps(y)) << 8)
+            return i + std::countr_zero(unsigned(mask));
+    }
+    return i + findScalar(data + i, n - i, value);
+}
+
+__attribute__((target("avx2")))
+bool equalAVX2(const double* a, const double* b, size_t n) noexcept {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d x = _mm256_cmp_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), _CMP_EQ_OQ);
+        __m256d y = _mm256_cmp_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), _CMP_EQ_OQ);
+        if (_mm256_movemask_pd(_mm256_and_pd(x, y)) != 0b1111) return false;
+    }
+    return equalScalar(a + i, b + i, n - i);
+}
+
+#endif
+
+struct Kernels {
+    size_t (*findInt)(const int64_t*, size_t, int64_t) noexcept = findScalar;
+    size_t (*findFloat)(const double*, size_t, double) noexcept = findScalar;
+    size_t (*findChar)(const char32_t*, size_t, char32_t) noexcept = findScalar;
+    bool (*equalFloat)(const double*, const double*, size_t) noexcept = equalScalar;
+
+    Kernels() noexcept {
+#ifdef PORKCHOP_SEARCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            findInt = findAVX2;
+            findFloat = findAVX2;
+            findChar = findAVX2;
+            equalFloat = equalAVX2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            findInt = findSSE2;
+            findFloat = findSSE2;
+            findChar = findSSE2;
+            equalFloat = equalSSE2;
+        }
+#endif
+    }
+};
+
+const Kernels kernels;
+
+}
+
+size_t find(const int64_t* data, size_t n, int64_t value) noexcept {
+    return kernels.findInt(data, n, value);
+}
+
+size_t find(const double* data, size_t n, double value) noexcept {
+    return kernels.findFloat(data, n, value);
+}
+
+size_t find(const char32_t* data, size_t n, char32_t value) noexcept {
+    return kernels.findChar(data, n, value);
+}
+
+size_t find(const uint8_t* data, size_t n, uint8_t value) noexcept {
+    auto found = static_cast<const uint8_t*>(n ? memchr(data, value, n) : nullptr);
+    return found ? found - data : n;
+}
+
+// bitwise equality is exactly the equality of integers, where memcmp is already vectorized by the C library
+bool equal(const int64_t* a, const int64_t* b, size_t n) noexcept {
+    return n == 0 || memcmp(a, b, n * sizeof(int64_t)) == 0;
+}
+
+bool equal(const double* a, const double* b, size_t n) noexcept {
+    return kernels.equalFloat(a, b, n);
+}
+
+bool equal(const char32_t* a, const char32_t* b, size_t n) noexcept {
+    return n == 0 || memcmp(a, b, n * sizeof(char32_t)) == 0;
+}
+
+bool equal(const uint8_t* a, const uint8_t* b, size_t n) noexcept {
+    return n == 0 || memcmp(a, b, n) == 0;
+}
+
+}
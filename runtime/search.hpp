@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Porkchop::Search {
+
+// Vectorized kernels over the flat storage of scalar lists, dispatched once by the features of the running CPU.
+// Floats follow the semantics of `==`, so NaN matches nothing and 0.0 matches -0.0.
+
+// Index of the first element equal to value, or n if there is none
+size_t find(const int64_t* data, size_t n, int64_t value) noexcept;
+size_t find(const double* data, size_t n, double value) noexcept;
+size_t find(const char32_t* data, size_t n, char32_t value) noexcept;
+size_t find(const uint8_t* data, size_t n, uint8_t value) noexcept;
+
+// Whether two arrays of n elements are equal element by element
+bool equal(const int64_t* a, const int64_t* b, size_t n) noexcept;
+bool equal(const double* a, const double* b, size_t n) noexcept;
+bool equal(const char32_t* a, const char32_t* b, size_t n) noexcept;
+bool equal(const uint8_t* a, const uint8_t* b, size_t n) noexcept;
+
+}
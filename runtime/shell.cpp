@@ -55,10 +55,11 @@ void onCommand(std::string_view line, Porkchop::Continuum& continuum, std::uniqu
 
 int main(int argc, const char* argv[]) try {
     Porkchop::forceUTF8();
+    Porkchop::VM vm;
+    Porkchop::configure(vm, argc, argv);
     const int argi = 1;
     Porkchop::Continuum continuum;
     Porkchop::Interpretation interpretation(&continuum);
-    Porkchop::VM vm;
     vm.init(argi, argc, argv);
     auto frame = std::make_unique<Porkchop::Frame>(&vm, &interpretation);
     bool newline = false;
@@ -111,6 +112,7 @@ int main(int argc, const char* argv[]) try {
             fprintf(stderr, "Runtime exception occurred: \n");
             fprintf(stderr, "%s", e.what());
         }
+        if (vm.compactHeap) vm.gc(); // defragment while waiting for the next command
     }
 } catch (std::bad_alloc& e) {
     fprintf(stderr, "Shell out of memory\n");
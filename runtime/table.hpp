@@ -0,0 +1,264 @@
+#pragma once
+
+#include <memory>
+#include <cstring>
+#include <bit>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "hash.hpp"
+#include "../util.hpp"
+
+namespace Porkchop {
+
+namespace Table {
+
+constexpr int8_t EMPTY = -128;
+constexpr int8_t DELETED = -2;
+constexpr size_t GROUP = 16;
+
+// control bytes of GROUP consecutive slots, each either EMPTY, DELETED or the low 7 bits of a hash
+struct Group {
+#ifdef __SSE2__
+    __m128i ctrl;
+
+    explicit Group(const int8_t* pos) noexcept: ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+    [[nodiscard]] uint32_t match(int8_t h2) const noexcept {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+    }
+
+    [[nodiscard]] uint32_t matchFree() const noexcept {
+        return _mm_movemask_epi8(_mm_cmplt_epi8(ctrl, _mm_set1_epi8(-1)));
+    }
+#else
+    int8_t ctrl[GROUP];
+
+    explicit Group(const int8_t* pos) noexcept { memcpy(ctrl, pos, GROUP); }
+
+    [[nodiscard]] uint32_t match(int8_t h2) const noexcept {
+        uint32_t bits = 0;
+        for (size_t i = 0; i < GROUP; ++i)
+            bits |= uint32_t(ctrl[i] == h2) << i;
+        return bits;
+    }
+
+    [[nodiscard]] uint32_t matchFree() const noexcept {
+        uint32_t bits = 0;
+        for (size_t i = 0; i < GROUP; ++i)
+            bits |= uint32_t(ctrl[i] < -1) << i;
+        return bits;
+    }
+#endif
+
+    [[nodiscard]] uint32_t matchEmpty() const noexcept {
+        return match(EMPTY);
+    }
+};
+
+inline $union& keyOf($union& slot) noexcept { return slot; }
+inline $union& keyOf(std::pair<$union, $union>& slot) noexcept { return slot.first; }
+
+}
+
+// An open-addressing hash table probing a group of control bytes at once.
+// Erasure leaves tombstones, so slot indices stay valid until the table is rehashed.
+template<typename Slot>
+struct FlatTable {
+    IdentityKind kind;
+
+private:
+    std::unique_ptr<int8_t[]> ctrl;
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0, count = 0, growthLeft = 0;
+
+public:
+    explicit FlatTable(IdentityKind kind) noexcept: kind(kind) {}
+
+    FlatTable(FlatTable const& other): kind(other.kind), mask(other.mask), count(other.count), growthLeft(other.growthLeft) {
+        if (size_t n = other.capacity()) {
+            ctrl = std::make_unique<int8_t[]>(n + Table::GROUP);
+            memcpy(ctrl.get(), other.ctrl.get(), n + Table::GROUP);
+            slots = std::make_unique<Slot[]>(n);
+            std::copy_n(other.slots.get(), n, slots.get());
+        }
+    }
+
+    FlatTable(FlatTable&&) noexcept = default;
+
+    [[nodiscard]] size_t size() const noexcept { return count; }
+
+    [[nodiscard]] bool empty() const noexcept { return count == 0; }
+
+    [[nodiscard]] size_t capacity() const noexcept { return slots ? mask + 1 : 0; }
+
+    // the smallest capacity holding n elements within the maximum load factor of 7/8
+    static size_t fit(size_t n) noexcept {
+        return std::bit_ceil(std::max(Table::GROUP, n + n / 7 + 1));
+    }
+
+    [[nodiscard]] bool occupied(size_t index) const noexcept { return ctrl[index] >= 0; }
+
+    Slot& slot(size_t index) noexcept { return slots[index]; }
+
+    // the first occupied index no less than the given one, or capacity() if none
+    [[nodiscard]] size_t next(size_t index) const noexcept {
+        size_t n = capacity();
+        while (index < n && ctrl[index] < 0) ++index;
+        return index;
+    }
+
+    Slot* find($union key) {
+        return dispatch([&]<IdentityKind K>() -> Slot* {
+            size_t index = findAs<K>(key, Identity<K>::hash(key));
+            return index != capacity() ? &slots[index] : nullptr;
+        });
+    }
+
+    bool contains($union key) {
+        return find(key) != nullptr;
+    }
+
+    // the slot holding the key, claimed if absent
+    Slot& emplace($union key) {
+        return dispatch([&]<IdentityKind K>() -> Slot& {
+            return slots[emplaceAs<K>(key)];
+        });
+    }
+
+    bool erase($union key) {
+        return dispatch([&]<IdentityKind K>() {
+            size_t index = findAs<K>(key, Identity<K>::hash(key));
+            if (index == capacity()) return false;
+            eraseAt(index);
+            return true;
+        });
+    }
+
+    void eraseAt(size_t index) noexcept {
+        setCtrl(index, Table::DELETED);
+        slots[index] = Slot{};
+        --count;
+    }
+
+    template<typename Predicate>
+    void eraseIf(Predicate predicate) {
+        for (size_t i = 0, n = capacity(); i < n; ++i) {
+            if (occupied(i) && predicate(slots[i])) {
+                eraseAt(i);
+            }
+        }
+    }
+
+    void reserve(size_t n) {
+        if (n > count + growthLeft) {
+            dispatch([&]<IdentityKind K>() { rehash<K>(fit(n)); });
+        }
+    }
+
+    // rehash into the smallest capacity holding the present elements
+    void shrink() {
+        dispatch([&]<IdentityKind K>() { rehash<K>(count ? fit(count) : 0); });
+    }
+
+    struct iterator {
+        FlatTable* table;
+        size_t index;
+
+        Slot& operator*() const noexcept { return table->slots[index]; }
+        Slot* operator->() const noexcept { return &table->slots[index]; }
+        iterator& operator++() noexcept { index = table->next(index + 1); return *this; }
+        bool operator==(iterator const& other) const noexcept { return index == other.index; }
+    };
+
+    iterator begin() noexcept { return {this, next(0)}; }
+    iterator end() noexcept { return {this, capacity()}; }
+
+private:
+    template<typename F>
+    decltype(auto) dispatch(F&& f) {
+        switch (kind) {
+            case IdentityKind::SELF:
+                return f.template operator()<IdentityKind::SELF>();
+            case IdentityKind::FLOAT:
+                return f.template operator()<IdentityKind::FLOAT>();
+            case IdentityKind::OBJECT:
+                return f.template operator()<IdentityKind::OBJECT>();
+        }
+        unreachable();
+    }
+
+    void setCtrl(size_t index, int8_t h2) noexcept {
+        ctrl[index] = h2;
+        // the first group is mirrored past the end, so a group may be loaded from any index
+        if (index < Table::GROUP) ctrl[mask + 1 + index] = h2;
+    }
+
+    template<IdentityKind K>
+    size_t findAs($union key, size_t hash) const {
+        if (!count) return capacity();
+        auto h2 = int8_t(hash & 0x7F);
+        for (size_t offset = (hash >> 7) & mask, step = 0;;) {
+            Table::Group group(ctrl.get() + offset);
+            for (uint32_t bits = group.match(h2); bits; bits &= bits - 1) {
+                size_t index = (offset + std::countr_zero(bits)) & mask;
+                if (Identity<K>::equals(Table::keyOf(slots[index]), key)) return index;
+            }
+            if (group.matchEmpty()) return capacity();
+            step += Table::GROUP;
+            offset = (offset + step) & mask;
+        }
+    }
+
+    size_t findFree(size_t hash) const noexcept {
+        for (size_t offset = (hash >> 7) & mask, step = 0;;) {
+            if (uint32_t bits = Table::Group(ctrl.get() + offset).matchFree()) {
+                return (offset + std::countr_zero(bits)) & mask;
+            }
+            step += Table::GROUP;
+            offset = (offset + step) & mask;
+        }
+    }
+
+    template<IdentityKind K>
+    size_t emplaceAs($union key) {
+        size_t hash = Identity<K>::hash(key);
+        if (size_t index = findAs<K>(key, hash); index != capacity()) return index;
+        if (!growthLeft) {
+            // tombstones are dropped by rehashing in place unless the table is really crowded
+            rehash<K>(count * 2 < capacity() ? capacity() : std::max(fit(count + 1), capacity() * 2));
+        }
+        size_t index = findFree(hash);
+        if (ctrl[index] == Table::EMPTY) --growthLeft;
+        setCtrl(index, int8_t(hash & 0x7F));
+        Table::keyOf(slots[index]) = key;
+        ++count;
+        return index;
+    }
+
+    template<IdentityKind K>
+    void rehash(size_t n) {
+        auto oldCtrl = std::move(ctrl);
+        auto oldSlots = std::move(slots);
+        size_t oldCapacity = oldSlots ? mask + 1 : 0;
+        mask = growthLeft = 0;
+        if (n) {
+            ctrl = std::make_unique<int8_t[]>(n + Table::GROUP);
+            memset(ctrl.get(), Table::EMPTY, n + Table::GROUP);
+            slots = std::make_unique<Slot[]>(n);
+            mask = n - 1;
+            growthLeft = n - n / 8 - count;
+        }
+        for (size_t i = 0; i < oldCapacity; ++i) {
+            if (oldCtrl[i] < 0) continue;
+            size_t hash = Identity<K>::hash(Table::keyOf(oldSlots[i]));
+            size_t index = findFree(hash);
+            setCtrl(index, int8_t(hash & 0x7F));
+            slots[index] = oldSlots[i];
+        }
+    }
+};
+
+}
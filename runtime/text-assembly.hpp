@@ -108,6 +108,9 @@ struct TextAssembly : Assembly {
                         case Opcode::TLOAD:
                         case Opcode::INC:
                         case Opcode::DEC:
+                        case Opcode::NEXT:
+                        case Opcode::LNEXT:
+                        case Opcode::DNEXT:
                         case Opcode::SJOIN:
                         case Opcode::UCMP:
                         case Opcode::ICMP:
@@ -2,16 +2,34 @@
 #include "frame.hpp"
 #include "../unicode/unicode.hpp"
 
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 namespace Porkchop {
 
+size_t Identity<IdentityKind::OBJECT>::hash($union u) {
+    return u.$object->hashCode();
+}
+
+bool Identity<IdentityKind::OBJECT>::equals($union u, $union v) {
+    return u.$object->equals(v.$object);
+}
+
 size_t Hasher::operator()($union u) const {
     switch (kind) {
         case IdentityKind::SELF:
-            return u.$size;
+            return Identity<IdentityKind::SELF>::hash(u);
         case IdentityKind::FLOAT:
-            return std::hash<double>()(u.$float);
+            return Identity<IdentityKind::FLOAT>::hash(u);
         case IdentityKind::OBJECT:
-            return u.$object->hashCode();
+            return Identity<IdentityKind::OBJECT>::hash(u);
     }
     unreachable();
 }
@@ -19,11 +37,11 @@ size_t Hasher::operator()($union u) const {
 bool Equator::operator()($union u, $union v) const {
     switch (kind) {
         case IdentityKind::SELF:
-            return u.$size == v.$size;
+            return Identity<IdentityKind::SELF>::equals(u, v);
         case IdentityKind::FLOAT:
-            return u.$float == v.$float;
+            return Identity<IdentityKind::FLOAT>::equals(u, v);
         case IdentityKind::OBJECT:
-            return u.$object->equals(v.$object);
+            return Identity<IdentityKind::OBJECT>::equals(u, v);
     }
     unreachable();
 }
@@ -54,22 +72,566 @@ std::string Stringifier::operator()($union value) const {
     unreachable();
 }
 
-void VM::markAll() {
-    _args->mark();
-    for (auto&& frame : frames) {
-        frame->markAll();
+// A unit of tracing work: either a whole object or a chunk of its children
+struct MarkTask {
+    static constexpr size_t WHOLE = -1;
+
+    Object* object;
+    size_t first, last;
+};
+
+// Work-stealing mark deque, owned by a single marking thread.
+// The owner pushes and pops at the back, while thieves steal from the front.
+struct Marker {
+    static constexpr size_t CHUNK = 4096;
+
+    std::mutex mutex;
+    std::deque<MarkTask> tasks;
+    std::atomic<size_t>& pending;
+    bool shared;
+    size_t bytes = 0;
+    std::vector<Dict*> weak;
+
+    Marker(std::atomic<size_t>& pending, bool shared): pending(pending), shared(shared) {}
+
+    void push(MarkTask task) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        std::unique_lock lock(mutex, std::defer_lock);
+        if (shared) lock.lock();
+        tasks.push_back(task);
+    }
+
+    bool pop(MarkTask& task) {
+        std::unique_lock lock(mutex, std::defer_lock);
+        if (shared) lock.lock();
+        if (tasks.empty()) return false;
+        task = tasks.back();
+        tasks.pop_back();
+        return true;
+    }
+
+    bool steal(MarkTask& task) {
+        std::lock_guard lock(mutex);
+        if (tasks.empty()) return false;
+        task = tasks.front();
+        tasks.pop_front();
+        return true;
+    }
+
+    void run(MarkTask task) {
+        if (task.last == MarkTask::WHOLE) {
+            task.object->walkMark();
+        } else {
+            task.object->walkMarkChunk(task.first, task.last);
+        }
+        pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+};
+
+thread_local Marker* marker = nullptr;
+
+void markLater(Object* object) {
+    marker->bytes += object->bytes();
+    marker->push({object, 0, MarkTask::WHOLE});
+}
+
+void markWeak(Dict* dict) {
+    marker->weak.push_back(dict);
+}
+
+bool markChunked(Object* object, size_t size) {
+    if (!marker->shared || size <= Marker::CHUNK) return false;
+    for (size_t first = 0; first < size; first += Marker::CHUNK) {
+        marker->push({object, first, std::min(first + Marker::CHUNK, size)});
+    }
+    return true;
+}
+
+// Mark phase driver, with a small pool of helper threads if configured.
+// Each thread scans its own share of roots, then drains its deque and steals from others.
+struct VM::Collector {
+    VM* vm;
+    std::atomic<size_t> pending = 0;
+    std::vector<std::unique_ptr<Marker>> markers;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    size_t epoch = 0;
+    size_t finished = 0;
+    bool stopping = false;
+
+    Collector(VM* vm, size_t n): vm(vm) {
+        for (size_t i = 0; i < n; ++i) {
+            markers.push_back(std::make_unique<Marker>(pending, n > 1));
+        }
+        for (size_t i = 1; i < n; ++i) {
+            threads.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    ~Collector() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto&& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void work(size_t id) {
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [&] { return stopping || epoch != seen; });
+                if (stopping) return;
+                seen = epoch;
+            }
+            mark(id);
+            {
+                std::lock_guard lock(mutex);
+                ++finished;
+            }
+            done.notify_one();
+        }
+    }
+
+    bool steal(size_t id, MarkTask& task) {
+        for (size_t i = 1; i < markers.size(); ++i) {
+            if (markers[(id + i) % markers.size()]->steal(task)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void mark(size_t id) {
+        auto self = markers[id].get();
+        marker = self;
+        vm->markRoots(id, markers.size());
+        pending.fetch_sub(1, std::memory_order_acq_rel);
+        MarkTask task{};
+        while (true) {
+            if (self->pop(task) || steal(id, task)) {
+                self->run(task);
+            } else if (pending.load(std::memory_order_acquire) == 0) {
+                break;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        marker = nullptr;
+    }
+
+    size_t live() {
+        size_t sum = 0;
+        for (auto&& marker : markers) {
+            sum += marker->bytes;
+            marker->bytes = 0;
+        }
+        return sum;
+    }
+
+    size_t collect() {
+        pending.store(markers.size(), std::memory_order_relaxed);
+        if (threads.empty()) {
+            mark(0);
+            return live();
+        }
+        {
+            std::lock_guard lock(mutex);
+            finished = 0;
+            ++epoch;
+        }
+        wake.notify_all();
+        mark(0);
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&] { return finished == threads.size(); });
+        return live();
+    }
+};
+
+// Live objects counted by type, together with the largest collections among them
+struct VM::Census {
+    static constexpr size_t TOP = 10;
+
+    struct Entry {
+        TypeReference type;
+        size_t objects = 0;
+        size_t bytes = 0;
+    };
+
+    size_t objects = 0;
+    size_t bytes = 0;
+    // keyed by identity, which is cheap as most types are interned
+    std::unordered_map<const Type*, Entry> types;
+    std::vector<std::pair<size_t, Object*>> largest;
+    std::vector<std::string> descriptions;
+
+    void count(Object* object) {
+        size_t size = object->bytes();
+        auto type = object->getType();
+        auto& entry = types[type.get()];
+        if (!entry.type) entry.type = std::move(type);
+        ++entry.objects;
+        entry.bytes += size;
+        ++objects;
+        bytes += size;
+        if (dynamic_cast<Collection*>(object)) {
+            auto less = [](auto const& a, auto const& b) { return a.first > b.first; };
+            largest.emplace_back(size, object);
+            std::push_heap(largest.begin(), largest.end(), less);
+            if (largest.size() > TOP) {
+                std::pop_heap(largest.begin(), largest.end(), less);
+                largest.pop_back();
+            }
+        }
+    }
+
+    // Describes the largest collections while they are still alive
+    void describe() {
+        std::sort(largest.begin(), largest.end(), [](auto const& a, auto const& b) { return a.first > b.first; });
+        for (auto&& [size, object] : largest) {
+            char buf[48];
+            snprintf(buf, sizeof buf, "%12zu %12zu  ", dynamic_cast<Sizeable*>(object)->size(), size);
+            descriptions.push_back(buf + object->getType()->toString());
+        }
+        largest.clear();
+    }
+
+    void print(FILE* file, const char* prefix) const {
+        fprintf(file, "%sheap census: %zu live objects, %zu bytes\n", prefix, objects, bytes);
+        // types left uninterned are merged with their equals by name
+        std::unordered_map<std::string, std::pair<size_t, size_t>> merged;
+        for (auto&& [_, entry] : types) {
+            auto& [objects, bytes] = merged[entry.type->toString()];
+            objects += entry.objects;
+            bytes += entry.bytes;
+        }
+        std::vector<std::pair<std::string, std::pair<size_t, size_t>>> entries(merged.begin(), merged.end());
+        std::sort(entries.begin(), entries.end(), [](auto const& a, auto const& b) { return a.second.second > b.second.second; });
+        fprintf(file, "%s%12s %12s  %s\n", prefix, "objects", "bytes", "type");
+        for (auto&& [type, entry] : entries) {
+            fprintf(file, "%s%12zu %12zu  %s\n", prefix, entry.first, entry.second, type.c_str());
+        }
+        if (descriptions.empty()) return;
+        fprintf(file, "%slargest collections:\n", prefix);
+        fprintf(file, "%s%12s %12s  %s\n", prefix, "size", "bytes", "type");
+        for (auto&& description : descriptions) {
+            fprintf(file, "%s%s\n", prefix, description.c_str());
+        }
+    }
+};
+
+// Allocations counted by the instruction of the innermost frame that requested them
+struct VM::Profile {
+    static constexpr size_t TOP = 20;
+
+    struct Site {
+        Assembly* assembly;
+        size_t func, pc;
+        size_t objects = 0;
+        size_t bytes = 0;
+    };
+
+    std::unordered_map<size_t, Site> sites;
+    Site native{};
+
+    void count(Frame* frame, size_t bytes) {
+        Site* site = &native;
+        if (frame) {
+            auto [it, _] = sites.try_emplace(frame->func << 32 | frame->pc, Site{frame->assembly, frame->func, frame->pc});
+            site = &it->second;
+        }
+        ++site->objects;
+        site->bytes += bytes;
+    }
+
+    void print(FILE* file) const {
+        std::vector<Site const*> top;
+        size_t objects = native.objects, bytes = native.bytes;
+        for (auto&& [_, site] : sites) {
+            top.push_back(&site);
+            objects += site.objects;
+            bytes += site.bytes;
+        }
+        std::sort(top.begin(), top.end(), [](auto a, auto b) { return a->bytes > b->bytes; });
+        if (top.size() > TOP) top.resize(TOP);
+        fprintf(file, "allocation profile: %zu objects, %zu bytes\n", objects, bytes);
+        fprintf(file, "%12s %12s  %s\n", "objects", "bytes", "site");
+        for (auto site : top) {
+            auto& instructions = std::get<Instructions>(site->assembly->functions[site->func]);
+            fprintf(file, "%12zu %12zu  func %zu pc %zu %s", site->objects, site->bytes, site->func, site->pc,
+                    OPCODE_NAME[(size_t) instructions[site->pc].first].data());
+            if (auto line = site->assembly->line(site->func, site->pc)) {
+                fprintf(file, " at line %zu", *line + 1);
+            }
+            fputc('\n', file);
+        }
+        if (native.objects) {
+            fprintf(file, "%12zu %12zu  outside any frame\n", native.objects, native.bytes);
+        }
+    }
+};
+
+VM::VM() = default;
+
+VM::~VM() = default;
+
+void VM::markRoots(size_t id, size_t n) {
+    if (id == 0 && _args) {
+        _args->mark();
+    }
+    for (size_t i = id; i < frames.size(); i += n) {
+        frames[i]->markAll();
+    }
+    for (size_t i = id; i < temporaries.size(); i += n) {
+        temporaries[i]->mark();
+    }
+}
+
+VM::Census VM::census() const {
+    Census census;
+    for (auto object = firstObject; object; object = object->next()) {
+        if (object->marked()) census.count(object);
+    }
+    census.describe();
+    return census;
+}
+
+void VM::heapDump(FILE* file) {
+    sweep(-1);
+    heapBytes = markAll();
+    auto census = this->census();
+    if (heapReport && (!peakCensus || census.bytes > peakCensus->bytes)) {
+        peakCensus = std::make_unique<Census>(census);
+    }
+    sweep();
+    census.print(file, "%% ");
+    // With every survivor unmarked, marking from one object through a marker that is never drained yields its references
+    std::atomic<size_t> pending = 0;
+    Marker recorder(pending, false);
+    marker = &recorder;
+    std::unordered_map<Object*, size_t> ids;
+    for (auto object = firstObject; object; object = object->next()) {
+        ids.emplace(object, ids.size() + 1);
+    }
+    fputs("graph\n", file);
+    fputs("0[\"roots\"]\n", file);
+    for (auto object = firstObject; object; object = object->next()) {
+        fprintf(file, "%zu[\"%s %zuB\"]\n", ids[object], object->getType()->toString().c_str(), object->bytes());
+    }
+    auto edges = [&](size_t from) {
+        for (auto&& task : recorder.tasks) {
+            fprintf(file, "%zu-->%zu\n", from, ids[task.object]);
+            task.object->link(task.object->next());
+        }
+        recorder.tasks.clear();
+    };
+    markRoots(0, 1);
+    edges(0);
+    for (auto object = firstObject; object; object = object->next()) {
+        object->walkMark();
+        edges(ids[object]);
+    }
+    marker = nullptr;
+}
+
+void VM::profile(size_t bytes) {
+    if (!allocSites) allocSites = std::make_unique<Profile>();
+    allocSites->count(frames.empty() ? nullptr : frames.back(), bytes);
+}
+
+void VM::report(FILE* file) {
+    if (allocProfile && allocSites) {
+        allocSites->print(file);
+    }
+    if (heapReport) {
+        gc();
+        if (peakCensus) peakCensus->print(file, "");
+    }
+}
+
+namespace {
+constexpr int64_t BOXED_INT_MIN = -128;
+constexpr int64_t BOXED_INT_MAX = 1023;
+constexpr char32_t BOXED_CHAR_MAX = 127;
+
+constexpr size_t BOXED_BOOL = 1;
+constexpr size_t BOXED_BYTE = BOXED_BOOL + 2;
+constexpr size_t BOXED_INT = BOXED_BYTE + 256;
+constexpr size_t BOXED_CHAR = BOXED_INT + (BOXED_INT_MAX - BOXED_INT_MIN + 1);
+constexpr size_t BOXED = BOXED_CHAR + BOXED_CHAR_MAX + 1;
+}
+
+Object* VM::box($union value, ScalarTypeKind kind) {
+    size_t index;
+    $union canonical;
+    switch (kind) {
+        case ScalarTypeKind::NONE:
+            index = 0;
+            canonical = nullptr;
+            break;
+        case ScalarTypeKind::BOOL:
+            index = BOXED_BOOL + value.$bool;
+            canonical = size_t(value.$bool);
+            break;
+        case ScalarTypeKind::BYTE:
+            index = BOXED_BYTE + value.$byte;
+            canonical = size_t(value.$byte);
+            break;
+        case ScalarTypeKind::INT:
+            if (value.$int < BOXED_INT_MIN || value.$int > BOXED_INT_MAX) return newObject<AnyScalar>(value, kind);
+            index = BOXED_INT + (value.$int - BOXED_INT_MIN);
+            canonical = value.$int;
+            break;
+        case ScalarTypeKind::CHAR:
+            if (value.$char > BOXED_CHAR_MAX) return newObject<AnyScalar>(value, kind);
+            index = BOXED_CHAR + value.$char;
+            canonical = size_t(value.$char);
+            break;
+        default:
+            return newObject<AnyScalar>(value, kind);
+    }
+    if (boxes.empty()) boxes.resize(BOXED);
+    auto& box = boxes[index];
+    if (!box) box = newImmortal<AnyScalar>(canonical, kind);
+    return box.get();
+}
+
+size_t VM::markAll() {
+    if (!collector) {
+        collector = std::make_unique<Collector>(this, gcThreads);
+    }
+    size_t bytes = collector->collect();
+    // values of weak dicts are left unmarked by the dicts themselves, so the entries no one else needs go before sweeping
+    for (auto&& marker : collector->markers) {
+        for (auto dict : marker->weak) {
+            dict->elements.eraseIf([](auto const& entry) { return !entry.second.$object->marked(); });
+        }
+        marker->weak.clear();
+    }
+    return bytes;
+}
+
+void VM::gc() {
+    if (disableGC) return;
+    auto start = std::chrono::steady_clock::now();
+    sweep(-1);
+    heapBytes = markAll();
+    if (heapReport && (!peakCensus || heapBytes > peakCensus->bytes)) {
+        peakCensus = std::make_unique<Census>(census());
+    }
+    if (compactHeap) compact();
+    if (lazySweep) {
+        unswept = firstObject;
+        firstObject = nullptr;
+    } else {
+        sweep();
     }
-    for (auto&& temporary : temporaries) {
-        temporary->mark();
+    if (compactHeap) trim();
+    threshold = std::max((size_t) (heapBytes * gcGrowth), gcMinHeap);
+    // growth never schedules the next collection past the heap limit
+    if (heapLimit) threshold = std::min(threshold, heapLimit);
+    ++stats.collections;
+    stats.bytesLive = heapBytes;
+    stats.pauseNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void VM::compact() {
+    for (auto object = firstObject; object; object = object->next()) {
+        if (object->marked()) {
+            object->compact();
+        }
     }
 }
 
+void VM::trim() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+// Parses a positive number, rejecting anything else than the given suffixes after it
+static double parsePositive(std::string_view name, const char* text, const char* suffixes = "") {
+    char* end;
+    auto value = strtod(text, &end);
+    if (end == text || (*end && (!strchr(suffixes, *end) || end[1])) || !(value > 0)) {
+        throw Exception("invalid value of garbage collector option " + std::string(name) + ": '" + text + "'");
+    }
+    return value;
+}
+
+// Parses a byte count with an optional K, M or G suffix
+static size_t parseBytes(std::string_view name, const char* text) {
+    auto value = parsePositive(name, text, "GgMmKk");
+    switch (text[strlen(text) - 1]) {
+        case 'G': case 'g': value *= 1024; [[fallthrough]];
+        case 'M': case 'm': value *= 1024; [[fallthrough]];
+        case 'K': case 'k': value *= 1024;
+    }
+    return (size_t) value;
+}
+
+bool VM::option(std::string_view name, const char* value) {
+    if (name == "threads") {
+        gcThreads = std::max<size_t>(1, (size_t) parsePositive(name, value));
+    } else if (name == "lazy-sweep") {
+        lazySweep = true;
+    } else if (name == "compact") {
+        compactHeap = true;
+    } else if (name == "growth") {
+        gcGrowth = std::max(1.0, parsePositive(name, value));
+    } else if (name == "min-heap") {
+        gcMinHeap = std::max(parseBytes(name, value), MIN_HEAP_FLOOR);
+    } else if (name == "heap-limit") {
+        heapLimit = parseBytes(name, value);
+    } else {
+        return false;
+    }
+    threshold = gcMinHeap;
+    return true;
+}
+
+const char* VM::configure(int& argc, const char**& argv) {
+    const std::pair<const char*, const char*> variables[] = {
+            {"threads", "PORKCHOP_GC_THREADS"},
+            {"lazy-sweep", "PORKCHOP_GC_LAZY_SWEEP"},
+            {"compact", "PORKCHOP_GC_COMPACT"},
+            {"growth", "PORKCHOP_GC_GROWTH"},
+            {"min-heap", "PORKCHOP_GC_MIN_HEAP"},
+            {"heap-limit", "PORKCHOP_GC_HEAP_LIMIT"},
+    };
+    for (auto [name, variable] : variables) {
+        if (auto value = getenv(variable)) {
+            option(name, value);
+        }
+    }
+    int consumed = 0;
+    for (int i = 1; i < argc && !strncmp(argv[i], "--gc-", 5); ++i, ++consumed) {
+        std::string_view flag = argv[i] + 5;
+        auto equal = flag.find('=');
+        auto value = equal == std::string_view::npos ? "" : argv[i] + 5 + equal + 1;
+        if (!option(flag.substr(0, equal), value)) {
+            return argv[i];
+        }
+    }
+    argv[consumed] = argv[0];
+    argv += consumed;
+    argc -= consumed;
+    return nullptr;
+}
+
 void VM::init(int argi, int argc, const char* argv[]) {
     _args = newObject<ObjectList>(std::vector<$union>{}, std::make_shared<ListType>(ScalarTypes::STRING));
     for (; argi < argc; ++argi) {
         _args->add(newObject<String>(argv[argi]));
     }
     disableIO = getenv("PORKCHOP_IO_DISABLE");
+    heapReport = getenv("PORKCHOP_HEAP_REPORT");
+    allocProfile = getenv("PORKCHOP_ALLOC_PROFILE");
 }
 
 $union call(Assembly *assembly, VM *vm, size_t func, std::vector<$union> captures) try {
@@ -125,14 +687,17 @@ bool Func::equals(Object *other) {
 }
 
 size_t Func::hashCode() {
-    size_t hash = func;
+    size_t hash = Hash::scalar(func);
     for (size_t i = 0; i < captures.size(); ++i) {
-        hash <<= 1;
-        hash ^= Hasher{getIdentityKind(prototype->P[i])}(captures[i]);
+        hash = Hash::combine(hash, Hasher{getIdentityKind(prototype->P[i])}(captures[i]));
     }
     return hash;
 }
 
+TypeReference AnyScalar::getType() {
+    return ScalarTypes::of(type);
+}
+
 std::string AnyScalar::toString() {
     return Stringifier{type}(value);
 }
@@ -156,28 +721,53 @@ bool AnyScalar::equals(Object *other) {
 size_t AnyScalar::hashCode() {
     switch (type) {
         case ScalarTypeKind::NONE:
-            return 0;
+            return Hash::scalar(0);
         case ScalarTypeKind::FLOAT:
-            return std::hash<double>()(value.$float);
+            return Identity<IdentityKind::FLOAT>::hash(value);
         default:
-            return value.$size;
+            return Identity<IdentityKind::SELF>::hash(value);
     }
 }
 
+void String::flatten() {
+    std::string buf;
+    buf.reserve(length);
+    // ropes built by repeated concatenation are deep, so they are walked without recursion
+    std::vector<String*> pending{this};
+    while (!pending.empty()) {
+        auto string = pending.back();
+        pending.pop_back();
+        if (string->left) {
+            pending.push_back(string->right);
+            pending.push_back(string->left);
+        } else {
+            buf += string->view();
+        }
+    }
+    flat = std::move(buf);
+    left = right = nullptr;
+}
+
 std::string String::toString() {
-    return value;
+    return std::string(view());
 }
 
 bool String::equals(Object *other) {
     if (this == other) return true;
     if (auto string = dynamic_cast<String*>(other)) {
-        return value == string->value;
+        if (length != string->length) return false;
+        if (hash && string->hash && hash != string->hash) return false;
+        return view() == string->view();
     }
     return false;
 }
 
 size_t String::hashCode() {
-    return std::hash<std::string>()(value);
+    if (!hash) {
+        auto sv = view();
+        hash = Hash::bytes(sv.data(), sv.size());
+    }
+    return hash;
 }
 
 std::string Pair::toString() {
@@ -194,7 +784,7 @@ bool Pair::equals(Object *other) {
 }
 
 size_t Pair::hashCode() {
-    return (Hasher{t}(first) << 1) ^ Hasher{u}(second);
+    return Hash::combine(Hasher{t}(first), Hasher{u}(second));
 }
 
 std::string More::toString() {
@@ -224,10 +814,9 @@ bool More::equals(Object *other) {
 }
 
 size_t More::hashCode() {
-    size_t hash = 0;
+    size_t hash = Hash::scalar(elements.size());
     for (size_t i = 0; i < elements.size(); ++i) {
-        hash <<= 1;
-        hash ^= Hasher{getIdentityKind(prototype->E[i])}(elements[i]);
+        hash = Hash::combine(hash, Hasher{getIdentityKind(prototype->E[i])}(elements[i]));
     }
     return hash;
 }
@@ -250,14 +839,16 @@ bool ObjectList::equals(Object *other) {
         return std::equal(elements.begin(), elements.end(), list->elements.begin(), list->elements.end(),
                           []($union lhs, $union rhs) { return lhs.$object->equals(rhs.$object); });
     }
+    if (auto list = dynamic_cast<PersistentList*>(other)) {
+        return list->equals(this);
+    }
     return Object::equals(other);
 }
 
 size_t ObjectList::hashCode() {
-    size_t hash = 0;
+    size_t hash = Hash::scalar(elements.size());
     for (auto&& element : elements) {
-        hash <<= 1;
-        hash ^= element.$object->hashCode();
+        hash = Hash::combine(hash, element.$object->hashCode());
     }
     return hash;
 }
@@ -277,11 +868,14 @@ bool NoneList::equals(Object *other) {
     if (auto list = dynamic_cast<NoneList*>(other)) {
         return count == list->count;
     }
+    if (auto list = dynamic_cast<PersistentList*>(other)) {
+        return list->equals(this);
+    }
     return Object::equals(other);
 }
 
 size_t NoneList::hashCode() {
-    return count;
+    return Hash::scalar(count);
 }
 
 std::string BoolList::toString() {
@@ -300,11 +894,18 @@ bool BoolList::equals(Object *other) {
     if (auto list = dynamic_cast<BoolList*>(other)) {
         return elements == list->elements;
     }
+    if (auto list = dynamic_cast<PersistentList*>(other)) {
+        return list->equals(this);
+    }
     return false;
 }
 
 size_t BoolList::hashCode() {
-    return std::hash<std::vector<bool>>()(elements);
+    size_t hash = Hash::scalar(elements.size());
+    for (bool element : elements) {
+        hash = Hash::combine(hash, element);
+    }
+    return hash;
 }
 
 std::string ByteList::toString() {
@@ -322,43 +923,48 @@ std::string ByteList::toString() {
 bool ByteList::equals(Object *other) {
     if (this == other) return true;
     if (auto list = dynamic_cast<ByteList*>(other)) {
-        return elements == list->elements;
+        return elements.size() == list->elements.size() && Search::equal(elements.data(), list->elements.data(), elements.size());
+    }
+    if (auto list = dynamic_cast<PersistentList*>(other)) {
+        return list->equals(this);
     }
     return false;
 }
 
 size_t ByteList::hashCode() {
-    std::basic_string_view sv{elements.begin(), elements.end()};
-    return std::hash<std::string_view>()(reinterpret_cast<std::string_view&>(sv));
+    return Hash::bytes(elements.data(), elements.size());
 }
 
-std::string ScalarList::toString() {
-    Stringifier sf{type};
+template<typename T>
+std::string ScalarList<T>::toString() {
+    Stringifier sf{kind};
     std::string buf = "[";
     bool first = true;
     for (auto&& element : elements) {
         if (first) { first = false; } else { buf += ", "; }
-        buf += sf(element);
+        buf += sf(wrap(element));
     }
     buf += "]";
     return buf;
 }
 
-bool ScalarList::equals(Object *other) {
+template<typename T>
+bool ScalarList<T>::equals(Object *other) {
     if (this == other) return true;
     if (auto list = dynamic_cast<ScalarList*>(other)) {
-        if (type != list->type) return false;
-        Equator equator{type == ScalarTypeKind::FLOAT ? IdentityKind::FLOAT : IdentityKind::SELF};
-        return std::equal(elements.begin(), elements.end(), list->elements.begin(), list->elements.end(), equator);
+        return elements.size() == list->elements.size() && Search::equal(elements.data(), list->elements.data(), elements.size());
+    }
+    if (auto list = dynamic_cast<PersistentList*>(other)) {
+        return list->equals(this);
     }
     return false;
 }
 
-size_t ScalarList::hashCode() {
-    Hasher hasher{type == ScalarTypeKind::FLOAT ? IdentityKind::FLOAT : IdentityKind::SELF};
-    size_t hash = 0;
+template<typename T>
+size_t ScalarList<T>::hashCode() {
+    size_t hash = Hash::scalar(elements.size());
     for (auto&& element : elements) {
-        hash += hasher(element);
+        hash = Hash::combine(hash, Identity<kind == ScalarTypeKind::FLOAT ? IdentityKind::FLOAT : IdentityKind::SELF>::hash(wrap(element)));
     }
     return hash;
 }
@@ -394,7 +1000,7 @@ size_t Set::hashCode() {
     for (auto&& element : elements) {
         hash += hasher(element);
     }
-    return hash;
+    return Hash::combine(hash, elements.size());
 }
 
 std::string Dict::toString() {
@@ -414,15 +1020,19 @@ std::string Dict::toString() {
 bool Dict::equals(Object *other) {
     if (this == other) return true;
     if (auto dict = dynamic_cast<Dict*>(other)) {
+        if (elements.size() != dict->elements.size()) return false;
         Equator valueequator{getIdentityKind(prototype->V)};
         for (auto&& [key, value] : elements) {
-            auto it = dict->elements.find(key);
-            if (it == dict->elements.end() || !valueequator(it->second, value)) {
+            auto slot = dict->elements.find(key);
+            if (!slot || !valueequator(slot->second, value)) {
                 return false;
             }
         }
         return true;
     }
+    if (auto dict = dynamic_cast<PersistentDict*>(other)) {
+        return dict->equals(this);
+    }
     return false;
 }
 
@@ -430,15 +1040,15 @@ size_t Dict::hashCode() {
     Hasher keyhasher{getIdentityKind(prototype->K)}, valuehasher{getIdentityKind(prototype->V)};
     size_t hash = 0;
     for (auto&& [key, value]: elements) {
-        hash += (keyhasher(key) << 1) ^ valuehasher(value);
+        hash += Hash::combine(keyhasher(key), valuehasher(value));
     }
-    return hash;
+    return Hash::combine(hash, elements.size());
 }
 
 bool ObjectList::ObjectListIterator::equals(Object *other) {
     if (this == other) return true;
     if (auto iter = dynamic_cast<ObjectList::ObjectListIterator*>(other)) {
-        return list == iter->list && first == iter->first;
+        return list == iter->list && index == iter->index;
     }
     return false;
 }
@@ -454,7 +1064,7 @@ bool NoneList::NoneListIterator::equals(Object *other) {
 bool BoolList::BoolListIterator::equals(Object *other) {
     if (this == other) return true;
     if (auto iter = dynamic_cast<BoolList::BoolListIterator*>(other)) {
-        return list == iter->list && first == iter->first;
+        return list == iter->list && index == iter->index;
     }
     return false;
 }
@@ -462,23 +1072,28 @@ bool BoolList::BoolListIterator::equals(Object *other) {
 bool ByteList::ByteListIterator::equals(Object *other) {
     if (this == other) return true;
     if (auto iter = dynamic_cast<ByteList::ByteListIterator*>(other)) {
-        return list == iter->list && first == iter->first;
+        return list == iter->list && index == iter->index;
     }
     return false;
 }
 
-bool ScalarList::ScalarListIterator::equals(Object *other) {
+template<typename T>
+bool ScalarList<T>::ScalarListIterator::equals(Object *other) {
     if (this == other) return true;
-    if (auto iter = dynamic_cast<ScalarList::ScalarListIterator*>(other)) {
-        return list == iter->list && first == iter->first;
+    if (auto iter = dynamic_cast<ScalarListIterator*>(other)) {
+        return list == iter->list && index == iter->index;
     }
     return false;
 }
 
+template struct ScalarList<int64_t>;
+template struct ScalarList<double>;
+template struct ScalarList<char32_t>;
+
 bool Set::SetIterator::equals(Object *other) {
     if (this == other) return true;
     if (auto iter = dynamic_cast<Set::SetIterator*>(other)) {
-        return set == iter->set && first == iter->first;
+        return set == iter->set && index == iter->index;
     }
     return false;
 }
@@ -496,11 +1111,11 @@ bool NoneSet::equals(Object *other) {
 }
 
 size_t NoneSet::hashCode() {
-    return state;
+    return Hash::scalar(state);
 }
 
 std::string BoolSet::toString() {
-    switch (hashCode()) {
+    switch (trueState << 1 | falseState) {
         case 0:
             return "@[]";
         case 1:
@@ -531,7 +1146,7 @@ bool BoolSet::equals(Object *other) {
 }
 
 size_t BoolSet::hashCode() {
-    return (trueState << 1) | falseState;
+    return Hash::scalar(trueState << 1 | falseState);
 }
 
 bool BoolSet::BoolSetIterator::equals(Object *other) {
@@ -564,7 +1179,7 @@ bool ByteSet::equals(Object *other) {
 }
 
 size_t ByteSet::hashCode() {
-    return std::hash<std::bitset<256>>()(set);
+    return Hash::bytes(&set, sizeof set);
 }
 
 bool ByteSet::ByteSetIterator::equals(Object *other) {
@@ -575,16 +1190,156 @@ bool ByteSet::ByteSetIterator::equals(Object *other) {
     return false;
 }
 
+void Dict::DictIterator::walkMark() {
+    dict->mark();
+    dict->pinned.store(true, std::memory_order_relaxed);
+    // a weak dict must not drop entries under a live iterator
+    if (dynamic_cast<WeakDict*>(dict)) {
+        for (auto&& [_, value] : dict->elements) {
+            value.$object->mark();
+        }
+    }
+    if (cache.has_value())
+        cache->$object->mark();
+}
+
 bool Dict::DictIterator::equals(Object *other) {
     if (this == other) return true;
     if (auto iter = dynamic_cast<Dict::DictIterator*>(other)) {
-        return dict == iter->dict && first == iter->first;
+        return dict == iter->dict && index == iter->index;
+    }
+    return false;
+}
+
+std::string PersistentList::toString() {
+    auto sf = stringifier(prototype->E);
+    std::string buf = "[";
+    bool first = true;
+    elements.forEach([&]($union element) {
+        if (first) { first = false; } else { buf += ", "; }
+        buf += sf(element);
+    });
+    buf += "]";
+    return buf;
+}
+
+// a plain list of the same type is indistinguishable, so it must compare and hash the same
+bool PersistentList::equals(Object *other) {
+    if (this == other) return true;
+    auto list = dynamic_cast<List*>(other);
+    if (!list || !prototype->equals(list->getType()) || elements.size() != list->size()) return false;
+    if (auto persistent = dynamic_cast<PersistentList*>(list); persistent && elements.shares(persistent->elements)) return true;
+    Equator equator{getIdentityKind(prototype->E)};
+    for (size_t i = 0; i < elements.size(); ++i) {
+        if (!equator(elements[i], canonical(list->load(i)))) return false;
+    }
+    return true;
+}
+
+size_t PersistentList::hashCode() {
+    size_t hash = Hash::scalar(elements.size());
+    if (auto scalar = dynamic_cast<ScalarType*>(prototype->E.get())) {
+        switch (scalar->S) {
+            case ScalarTypeKind::NONE:
+                return hash;
+            case ScalarTypeKind::BOOL:
+                elements.forEach([&]($union element) { hash = Hash::combine(hash, element.$bool); });
+                return hash;
+            case ScalarTypeKind::BYTE: {
+                std::vector<uint8_t> bytes;
+                bytes.reserve(elements.size());
+                elements.forEach([&]($union element) { bytes.push_back(element.$byte); });
+                return Hash::bytes(bytes.data(), bytes.size());
+            }
+            default:
+                break;
+        }
+    }
+    Hasher hasher{getIdentityKind(prototype->E)};
+    elements.forEach([&]($union element) {
+        hash = Hash::combine(hash, hasher(element));
+    });
+    return hash;
+}
+
+std::string PersistentDict::toString() {
+    auto ksf = stringifier(prototype->K), vsf = stringifier(prototype->V);
+    std::string buf = "@[";
+    bool first = true;
+    elements.forEach([&]($union key, $union value) {
+        if (first) { first = false; } else { buf += ", "; }
+        buf += ksf(key);
+        buf += ": ";
+        buf += vsf(value);
+    });
+    buf += "]";
+    return buf;
+}
+
+// a plain dict of the same type is indistinguishable, so it must compare and hash the same
+bool PersistentDict::equals(Object *other) {
+    if (this == other) return true;
+    auto compare = [this, other](size_t size, auto find) {
+        if (!prototype->equals(other->getType()) || elements.size() != size) return false;
+        Equator valueequator{getIdentityKind(prototype->V)};
+        bool equal = true;
+        elements.forEach([&]($union key, $union value) {
+            if (!equal) return;
+            const $union* found = find(key);
+            equal = found && valueequator(*found, value);
+        });
+        return equal;
+    };
+    if (auto dict = dynamic_cast<PersistentDict*>(other)) {
+        if (elements.shares(dict->elements)) return true;
+        return compare(dict->elements.size(), [dict]($union key) { return dict->elements.find(key); });
+    }
+    if (auto dict = dynamic_cast<Dict*>(other)) {
+        return compare(dict->elements.size(), [dict]($union key) -> const $union* {
+            auto slot = dict->elements.find(key);
+            return slot ? &slot->second : nullptr;
+        });
+    }
+    return false;
+}
+
+size_t PersistentDict::hashCode() {
+    Hasher keyhasher{getIdentityKind(prototype->K)}, valuehasher{getIdentityKind(prototype->V)};
+    size_t hash = 0;
+    elements.forEach([&]($union key, $union value) {
+        hash += Hash::combine(keyhasher(key), valuehasher(value));
+    });
+    return Hash::combine(hash, elements.size());
+}
+
+bool PersistentList::PersistentListIterator::equals(Object *other) {
+    if (this == other) return true;
+    if (auto iter = dynamic_cast<PersistentList::PersistentListIterator*>(other)) {
+        return list == iter->list && elements.shares(iter->elements) && index == iter->index;
+    }
+    return false;
+}
+
+void PersistentDict::PersistentDictIterator::walkMark() {
+    dict->mark();
+    // the entries iterated over may have been updated since
+    if (!elements.shares(dict->elements))
+        dict->markEntries(elements);
+    if (cache.has_value())
+        cache->$object->mark();
+}
+
+bool PersistentDict::PersistentDictIterator::equals(Object *other) {
+    if (this == other) return true;
+    if (auto iter = dynamic_cast<PersistentDict::PersistentDictIterator*>(other)) {
+        return dict == iter->dict && elements.shares(iter->elements) && current == iter->current;
     }
     return false;
 }
 
 Coroutine::Coroutine(TypeReference R, std::unique_ptr<Frame> frame) : frame(std::move(frame)) {
-    E = std::move(R);
+    // R is the iterator type *E of the yielding function
+    E = dynamic_cast<IterType*>(R.get())->E;
 }
 
 void Coroutine::walkMark() {
@@ -7,8 +7,13 @@
 #include <optional>
 #include <algorithm>
 #include <bitset>
+#include <atomic>
+#include <array>
 
 #include "../type.hpp"
+#include "table.hpp"
+#include "persistent.hpp"
+#include "search.hpp"
 
 
 namespace Porkchop {
@@ -17,6 +22,7 @@ struct VM;
 struct Frame;
 struct Assembly;
 struct List;
+struct AnyScalar;
 
 struct Hasher {
     IdentityKind kind;
@@ -51,13 +57,26 @@ struct Exception : std::runtime_error {
     }
 };
 
+struct Marker;
+
+// Defers tracing of a freshly marked object to the marker of current thread.
+void markLater(Object* object);
+
+// Splits tracing of a large object into chunks when marking in parallel.
+bool markChunked(Object* object, size_t size);
+
+struct Dict;
+
+// Defers dropping the unreachable values of a weak dict found alive until marking ends.
+void markWeak(Dict* dict);
+
 struct Object {
     friend struct VM;
+    friend struct Marker;
 
     void mark() {
-        if (marked) return;
-        marked = true;
-        walkMark();
+        if (header.fetch_or(MARK, std::memory_order_relaxed) & MARK) return;
+        markLater(this);
     }
 
     virtual ~Object() = default;
@@ -73,30 +92,79 @@ struct Object {
     }
 
     virtual size_t hashCode() {
-        return std::hash<void*>()(this);
+        return Hash::scalar(reinterpret_cast<size_t>(this));
+    }
+
+    // Estimated footprint of the object itself and the buffers it owns
+    virtual size_t bytes() {
+        return sizeof(Object);
     }
 
 protected:
-    bool marked = false;
-    Object* nextObject = nullptr;
-    VM* vm = nullptr;
+    static constexpr uintptr_t MARK = 1;
+
+    // The next object in the object list of the VM, tagged with the mark bit
+    std::atomic<uintptr_t> header = 0;
+
+    [[nodiscard]] Object* next() const noexcept {
+        return reinterpret_cast<Object*>(header.load(std::memory_order_relaxed) & ~MARK);
+    }
+
+    [[nodiscard]] bool marked() const noexcept {
+        return header.load(std::memory_order_relaxed) & MARK;
+    }
+
+    void link(Object* next, bool marked = false) noexcept {
+        header.store(reinterpret_cast<uintptr_t>(next) | marked, std::memory_order_relaxed);
+    }
+
     virtual void walkMark() {}
+    virtual void walkMarkChunk(size_t first, size_t last) {}
+    virtual void compact() {}
 };
 
+static_assert(sizeof(Object) == 2 * sizeof(void*), "an object header is a vtable pointer and a tagged list pointer");
+
+// Releases the spare capacity of a buffer once it holds less than half of it.
+template<typename Buffer>
+void shrink(Buffer& buffer) {
+    if (buffer.capacity() > 2 * buffer.size() + 16) buffer.shrink_to_fit();
+}
+
 struct VM {
     std::vector<Frame*> frames;
     std::vector<Object*> temporaries;
     bool disableGC = false;
+    bool lazySweep = false;
+    bool compactHeap = false;
+    size_t gcThreads = 1;
+    double gcGrowth = 2.0;
+    size_t gcMinHeap = 1 << 20;
+    size_t heapLimit = 0;
+    bool heapReport = false;
+    bool allocProfile = false;
+
+    struct GCStats {
+        size_t collections = 0;
+        size_t pauseNanos = 0;
+        size_t bytesAllocated = 0;
+        size_t bytesLive = 0;
+        size_t bytesPeak = 0;
+    } stats;
+
+    VM();
+    ~VM();
 
     struct ObjectHolder {
+        VM* vm;
         Object* object;
 
-        ObjectHolder(Object* object): object(object) {
-            object->vm->temporaries.push_back(object);
+        ObjectHolder(VM* vm, Object* object): vm(vm), object(object) {
+            vm->temporaries.push_back(object);
         }
 
         ~ObjectHolder() {
-            object->vm->temporaries.pop_back();
+            vm->temporaries.pop_back();
         }
 
         template<typename T>
@@ -118,50 +186,136 @@ struct VM {
     template<std::derived_from<Object> T, typename... Args>
         requires std::constructible_from<T, Args...>
     T* newObject(Args&&... args) {
-        if (numObjects > maxObjects) gc();
+        if (unswept) sweep(SWEEP_BUDGET);
         auto object = new T(std::forward<Args>(args)...);
-        object->nextObject = firstObject;
-        object->vm = this;
+        object->link(firstObject);
         firstObject = object;
-        ++numObjects;
+        size_t bytes = object->bytes();
+        allocate(bytes);
+        if (allocProfile) profile(bytes);
+        if (heapBytes > threshold || overLimit()) {
+            ObjectHolder holder(this, object);
+            gc();
+            if (overLimit()) throw Exception("heap limit exceeded");
+        }
         return object;
     }
 
-    void markAll();
+    [[nodiscard]] bool overLimit(size_t bytes = 0) const {
+        return heapLimit && heapBytes + bytes > heapLimit;
+    }
+
+    // Makes room for bytes more under the heap limit, collecting first if necessary
+    void reserve(size_t bytes) {
+        if (!overLimit(bytes)) return;
+        gc();
+        if (overLimit(bytes)) throw Exception("heap limit exceeded");
+    }
+
+    // Creates an object owned by the caller instead of the collector, which never traces nor frees it
+    template<std::derived_from<Object> T, typename... Args>
+        requires std::constructible_from<T, Args...>
+    std::unique_ptr<T> newImmortal(Args&&... args) {
+        auto object = std::make_unique<T>(std::forward<Args>(args)...);
+        object->link(nullptr, true);
+        return object;
+    }
+
+    void allocate(size_t bytes) {
+        heapBytes += bytes;
+        stats.bytesAllocated += bytes;
+        stats.bytesPeak = std::max(stats.bytesPeak, heapBytes);
+    }
+
+    // Accounts for the growth of an object after its allocation, which must be reachable
+    void grow(size_t before, size_t after) {
+        if (after <= before) return;
+        allocate(after - before);
+        reserve(0);
+    }
+
+    size_t markAll();
+
+    // Shrinks the buffers of marked objects, as objects themselves never move.
+    void compact();
+
+    // Returns the pages freed by the last sweep to the operating system.
+    void trim();
 
     void sweep() {
-        Object** object = &firstObject;
-        while (*object) {
-            if ((*object)->marked) {
-                (*object)->marked = false;
-                object = &(*object)->nextObject;
+        Object* previous = nullptr;
+        for (Object* object = firstObject; object;) {
+            Object* next = object->next();
+            if (object->marked()) {
+                object->link(next);
+                previous = object;
             } else {
-                Object* garbage = *object;
-                *object = garbage->nextObject;
-                delete garbage;
-                --numObjects;
+                if (previous) previous->link(next); else firstObject = next;
+                delete object;
             }
+            object = next;
         }
     }
 
-    void gc() {
-        if (disableGC) return;
-        markAll();
-        sweep();
-        maxObjects = std::max(numObjects * 2, 1024);
+    // Sweeps at most budget objects left behind by the last lazy collection.
+    // Survivors are moved back to the object list, so that allocations after marking are never visited.
+    void sweep(size_t budget) {
+        for (; unswept && budget; --budget) {
+            Object* object = unswept;
+            unswept = object->next();
+            if (object->marked()) {
+                object->link(firstObject);
+                firstObject = object;
+            } else {
+                delete object;
+            }
+        }
     }
 
+    void gc();
+
+    // Boxes a scalar as any, sharing one immortal box per value for none, bools, bytes, small ints and ASCII chars
+    Object* box($union value, ScalarTypeKind kind);
+
+    // Collects, then writes a census of the live objects as Mermaid comments followed by the graph of their references.
+    void heapDump(FILE* file);
+
+    // Prints the diagnostics requested through the environment, called once on exit.
+    void report(FILE* file);
+
+    // Reads the collector settings from the environment, then consumes leading --gc-* flags.
+    // Returns the first unrecognized --gc-* flag, if any.
+    const char* configure(int& argc, const char**& argv);
+
     void init(int argi, int argc, const char *argv[]);
 
     FILE* out = stdout;
     FILE* in = stdin;
     bool disableIO = false;
-    List* _args;
+    List* _args = nullptr;
 
 private:
+    struct Collector;
+    static constexpr size_t SWEEP_BUDGET = 16;
+    // a smaller heap would collect on almost every allocation
+    static constexpr size_t MIN_HEAP_FLOOR = 4096;
+
+    struct Census;
+    struct Profile;
+
+    bool option(std::string_view name, const char* value);
+    void markRoots(size_t id, size_t n);
+    [[nodiscard]] Census census() const;
+    void profile(size_t bytes);
+
+    std::unique_ptr<Collector> collector;
     Object* firstObject = nullptr;
-    int numObjects = 0;
-    int maxObjects = 1024;
+    Object* unswept = nullptr;
+    std::vector<std::unique_ptr<AnyScalar>> boxes;
+    std::unique_ptr<Census> peakCensus;
+    std::unique_ptr<Profile> allocSites;
+    size_t heapBytes = 0;
+    size_t threshold = gcMinHeap;
 };
 
 $union call(Assembly *assembly, VM *vm, size_t func, std::vector<$union> captures);
@@ -174,7 +328,7 @@ struct Func : Object {
     Func(size_t func, std::shared_ptr<FuncType> prototype, std::vector<$union> captures = {})
             : func(func), prototype(std::move(prototype)), captures(std::move(captures)) {}
 
-    Func* bind(std::vector<$union> params) {
+    Func* bind(VM* vm, std::vector<$union> params) {
         auto P = prototype->P;
         P.erase(P.begin(), P.begin() + params.size());
         auto cap = captures;
@@ -192,6 +346,10 @@ struct Func : Object {
 
     TypeReference getType() override { return prototype; }
 
+    size_t bytes() override {
+        return sizeof(Func) + captures.capacity() * sizeof($union);
+    }
+
     $union call(Assembly *assembly, VM *vm) const;
 
     std::string toString() override;
@@ -207,7 +365,7 @@ struct AnyScalar : Object {
 
     AnyScalar($union value, ScalarTypeKind type): value(value), type(type) {}
 
-    TypeReference getType() override { return std::make_shared<ScalarType>(type); }
+    TypeReference getType() override;
 
     std::string toString() override;
 
@@ -221,14 +379,63 @@ struct Sizeable {
 };
 
 struct String : Object, Sizeable {
-    std::string value;
+    // Concatenations at least this long are made ropes instead of being copied
+    static constexpr size_t ROPE_THRESHOLD = 256;
+    // Substrings at least this long share the buffer of their base, shorter ones fit in the small string buffer
+    static constexpr size_t VIEW_THRESHOLD = 16;
+
+    explicit String(std::string value): flat(std::move(value)), length(flat.length()) {}
+
+    // A rope concatenating two strings, flattened on the first access to its value
+    String(String* left, String* right): left(left), right(right), length(left->length + right->length) {}
+
+    // A view of length bytes of base starting from offset, which keeps base alive
+    String(String* base, size_t offset, size_t length): length(length) {
+        base->view();
+        this->base = base->base ? base->base : base;
+        this->offset = base->offset + offset;
+    }
+
+    // Contents without copying, valid as long as this string is alive
+    std::string_view view() {
+        if (left) flatten();
+        if (base) return std::string_view(base->flat).substr(offset, length);
+        return flat;
+    }
+
+    // Contents as a null-terminated string, which copies a view out of its base
+    std::string const& value() {
+        if (left) flatten();
+        if (base) {
+            flat = view();
+            base = nullptr;
+            offset = 0;
+        }
+        return flat;
+    }
 
-    explicit String(std::string value): value(std::move(value)) {}
+    void walkMark() override {
+        if (left) {
+            left->mark();
+            right->mark();
+        }
+        if (base) {
+            base->mark();
+        }
+    }
 
     TypeReference getType() override { return ScalarTypes::STRING; }
 
     size_t size() override {
-        return value.length();
+        return length;
+    }
+
+    size_t bytes() override {
+        return sizeof(String) + flat.capacity();
+    }
+
+    void compact() override {
+        shrink(flat);
     }
 
     std::string toString() override;
@@ -236,6 +443,18 @@ struct String : Object, Sizeable {
     bool equals(Object *other) override;
 
     size_t hashCode() override;
+
+private:
+    std::string flat;
+    String* left = nullptr;
+    String* right = nullptr;
+    String* base = nullptr;
+    size_t offset = 0;
+    size_t length;
+    // Strings are never mutated, so the hash is computed on first use, where 0 stands for not yet
+    size_t hash = 0;
+
+    void flatten();
 };
 
 struct Tuple : Object {
@@ -260,13 +479,23 @@ struct Pair : Tuple {
         return index == 0 ? std::pair{first, t == IdentityKind::OBJECT} : std::pair{second, u == IdentityKind::OBJECT};
     }
 
-    TypeReference getType() override { return std::make_shared<TupleType>(std::vector{T, U}); }
+    TypeReference getType() override {
+        if (!type) type = intern(std::make_shared<TupleType>(std::vector{T, U}));
+        return type;
+    }
+
+    size_t bytes() override {
+        return sizeof(Pair);
+    }
 
     std::string toString() override;
 
     bool equals(Object *other) override;
 
     size_t hashCode() override;
+
+private:
+    TypeReference type; // interned on first use, as most pairs are never asked for
 };
 
 struct More : Tuple {
@@ -290,6 +519,10 @@ struct More : Tuple {
 
     TypeReference getType() override { return prototype; }
 
+    size_t bytes() override {
+        return sizeof(More) + elements.capacity() * sizeof($union);
+    }
+
     std::string toString() override;
 
     bool equals(Object *other) override;
@@ -300,7 +533,7 @@ struct More : Tuple {
 struct Iterator;
 
 struct Iterable : Object {
-    virtual Iterator* iterator() = 0;
+    virtual Iterator* iterator(VM* vm) = 0;
 };
 
 struct Iterator : Iterable {
@@ -317,12 +550,16 @@ struct Iterator : Iterable {
     }
 
     TypeReference getType() override {
-        return std::make_shared<IterType>(E);
+        if (!type) type = intern(std::make_shared<IterType>(E));
+        return type;
     }
 
-    Iterator * iterator() override {
+    Iterator * iterator(VM*) override {
         return this;
     }
+
+private:
+    TypeReference type; // interned on first use, since E is set by the constructor of the subclass
 };
 
 
@@ -335,6 +572,18 @@ struct Collection : Iterable, Sizeable {
 struct List : Collection {
     virtual $union load(size_t index) = 0;
     virtual void store(size_t index, $union element) = 0;
+
+    // steps an index over the list in place, as a for loop does without any iterator
+    virtual bool next(size_t& index, $union& element) {
+        if (index >= size()) return false;
+        element = load(index++);
+        return true;
+    }
+
+    // whether the elements loaded are objects rather than values
+    virtual bool holdsObjects() {
+        return false;
+    }
 };
 
 struct ObjectList : List {
@@ -345,8 +594,13 @@ struct ObjectList : List {
         : elements(std::move(elements)), prototype(std::move(prototype)) {}
 
     void walkMark() override {
-        for (auto&& element : elements) {
-            element.$object->mark();
+        if (markChunked(this, elements.size())) return;
+        walkMarkChunk(0, elements.size());
+    }
+
+    void walkMarkChunk(size_t first, size_t last) override {
+        for (; first < last; ++first) {
+            elements[first].$object->mark();
         }
     }
 
@@ -360,6 +614,16 @@ struct ObjectList : List {
         elements[index] = element;
     }
 
+    bool next(size_t& index, $union& element) override {
+        if (index >= elements.size()) return false;
+        element = elements[index++];
+        return true;
+    }
+
+    bool holdsObjects() override {
+        return true;
+    }
+
     void add($union element) override {
         elements.push_back(element);
     }
@@ -374,7 +638,7 @@ struct ObjectList : List {
     }
 
     void remove($union element) override {
-        elements.erase(find(element));
+        if (auto it = find(element); it != elements.end()) elements.erase(it);
     }
 
     size_t size() override {
@@ -383,9 +647,9 @@ struct ObjectList : List {
 
     struct ObjectListIterator : Iterator {
         ObjectList* list;
-        std::vector<$union>::iterator first, last;
+        size_t index = 0;
 
-        explicit ObjectListIterator(ObjectList* list): list(list), first(list->elements.begin()), last(list->elements.end()) {
+        explicit ObjectListIterator(ObjectList* list): list(list) {
             E = list->prototype->E;
         }
 
@@ -394,8 +658,8 @@ struct ObjectList : List {
         }
 
         bool move() override {
-            if (first != last) {
-                cache = *first++;
+            if (index < list->elements.size()) {
+                cache = list->elements[index++];
                 return true;
             }
             return false;
@@ -404,10 +668,18 @@ struct ObjectList : List {
         bool equals(Object *other) override;
     };
 
-    Iterator * iterator() override {
+    Iterator * iterator(VM* vm) override {
         return vm->newObject<ObjectListIterator>(this);
     }
 
+    size_t bytes() override {
+        return sizeof(ObjectList) + elements.capacity() * sizeof($union);
+    }
+
+    void compact() override {
+        shrink(elements);
+    }
+
     std::string toString() override;
 
     bool equals(Object *other) override;
@@ -420,7 +692,10 @@ struct NoneList : List {
 
     explicit NoneList(size_t count): count(count) {}
 
-    TypeReference getType() override { return std::make_shared<ListType>(ScalarTypes::NONE); }
+    TypeReference getType() override {
+        static const TypeReference type = intern(std::make_shared<ListType>(ScalarTypes::NONE));
+        return type;
+    }
 
     void store(size_t index, $union element) override {}
 
@@ -433,11 +708,11 @@ struct NoneList : List {
     }
 
     void remove($union element) override {
-        --count;
+        if (count) --count;
     }
 
     bool contains($union element) override {
-        return true;
+        return count;
     }
 
     size_t size() override {
@@ -464,7 +739,7 @@ struct NoneList : List {
         bool equals(Object *other) override;
     };
 
-    Iterator * iterator() override {
+    Iterator * iterator(VM* vm) override {
         return vm->newObject<NoneListIterator>(this);
     }
 
@@ -480,7 +755,10 @@ struct BoolList : List {
 
     explicit BoolList(std::vector<bool> elements): elements(std::move(elements)) {}
 
-    TypeReference getType() override { return std::make_shared<ListType>(ScalarTypes::BOOL); }
+    TypeReference getType() override {
+        static const TypeReference type = intern(std::make_shared<ListType>(ScalarTypes::BOOL));
+        return type;
+    }
 
     void store(size_t index, $union element) override {
         elements[index] = element.$bool;
@@ -499,7 +777,7 @@ struct BoolList : List {
     }
 
     void remove($union element) override {
-        elements.erase(find(element));
+        if (auto it = find(element); it != elements.end()) elements.erase(it);
     }
 
     bool contains($union element) override {
@@ -512,9 +790,9 @@ struct BoolList : List {
 
     struct BoolListIterator : Iterator {
         BoolList* list;
-        std::vector<bool>::iterator first, last;
+        size_t index = 0;
 
-        explicit BoolListIterator(BoolList* list): list(list), first(list->elements.begin()), last(list->elements.end()) {
+        explicit BoolListIterator(BoolList* list): list(list) {
             E = ScalarTypes::BOOL;
         }
 
@@ -523,8 +801,8 @@ struct BoolList : List {
         }
 
         bool move() override {
-            if (first != last) {
-                cache = (bool) *first++;
+            if (index < list->elements.size()) {
+                cache = (bool) list->elements[index++];
                 return true;
             }
             return false;
@@ -533,10 +811,18 @@ struct BoolList : List {
         bool equals(Object *other) override;
     };
 
-    Iterator * iterator() override {
+    Iterator * iterator(VM* vm) override {
         return vm->newObject<BoolListIterator>(this);
     }
 
+    size_t bytes() override {
+        return sizeof(BoolList) + elements.capacity() / 8;
+    }
+
+    void compact() override {
+        shrink(elements);
+    }
+
     std::string toString() override;
 
     bool equals(Object *other) override;
@@ -549,7 +835,10 @@ struct ByteList : List {
 
     explicit ByteList(std::vector<uint8_t> elements): elements(std::move(elements)) {}
 
-    TypeReference getType() override { return std::make_shared<ListType>(ScalarTypes::BYTE); }
+    TypeReference getType() override {
+        static const TypeReference type = intern(std::make_shared<ListType>(ScalarTypes::BYTE));
+        return type;
+    }
 
     void store(size_t index, $union element) override {
         elements[index] = element.$byte;
@@ -564,11 +853,11 @@ struct ByteList : List {
     }
 
     auto find($union element) {
-        return std::find(elements.begin(), elements.end(), element.$byte);
+        return elements.begin() + Search::find(elements.data(), elements.size(), element.$byte);
     }
 
     void remove($union element) override {
-        elements.erase(find(element));
+        if (auto it = find(element); it != elements.end()) elements.erase(it);
     }
 
     bool contains($union element) override {
@@ -581,9 +870,9 @@ struct ByteList : List {
 
     struct ByteListIterator : Iterator {
         ByteList* list;
-        std::vector<uint8_t>::iterator first, last;
+        size_t index = 0;
 
-        explicit ByteListIterator(ByteList* list): list(list), first(list->elements.begin()), last(list->elements.end()) {
+        explicit ByteListIterator(ByteList* list): list(list) {
             E = ScalarTypes::BYTE;
         }
 
@@ -592,8 +881,8 @@ struct ByteList : List {
         }
 
         bool move() override {
-            if (first != last) {
-                cache = *first++;
+            if (index < list->elements.size()) {
+                cache = list->elements[index++];
                 return true;
             }
             return false;
@@ -602,10 +891,18 @@ struct ByteList : List {
         bool equals(Object *other) override;
     };
 
-    Iterator * iterator() override {
+    Iterator * iterator(VM* vm) override {
         return vm->newObject<ByteListIterator>(this);
     }
 
+    size_t bytes() override {
+        return sizeof(ByteList) + elements.capacity();
+    }
+
+    void compact() override {
+        shrink(elements);
+    }
+
     std::string toString() override;
 
     bool equals(Object *other) override;
@@ -613,34 +910,56 @@ struct ByteList : List {
     size_t hashCode() override;
 };
 
+// A list of ints, floats or chars stored unboxed in their native width
+template<typename T>
 struct ScalarList : List {
-    std::vector<$union> elements;
-    ScalarTypeKind type;
+    static constexpr ScalarTypeKind kind = std::same_as<T, double> ? ScalarTypeKind::FLOAT
+                                         : std::same_as<T, char32_t> ? ScalarTypeKind::CHAR
+                                         : ScalarTypeKind::INT;
+    std::vector<T> elements;
 
-    explicit ScalarList(std::vector<$union> elements, ScalarTypeKind type): elements(std::move(elements)), type(type) {}
+    explicit ScalarList(std::vector<T> elements): elements(std::move(elements)) {}
 
-    TypeReference getType() override { return std::make_shared<ListType>(std::make_shared<ScalarType>(type)); }
+    static T unwrap($union element) {
+        if constexpr (kind == ScalarTypeKind::FLOAT) return element.$float;
+        else if constexpr (kind == ScalarTypeKind::CHAR) return element.$char;
+        else return element.$int;
+    }
+
+    static $union wrap(T element) {
+        if constexpr (kind == ScalarTypeKind::CHAR) return size_t(element); // clears the upper bytes
+        else return element;
+    }
+
+    TypeReference getType() override {
+        static const TypeReference type = intern(std::make_shared<ListType>(ScalarTypes::of(kind)));
+        return type;
+    }
 
     void store(size_t index, $union element) override {
-        elements[index] = element;
+        elements[index] = unwrap(element);
     }
 
     $union load(size_t index) override {
-        return elements[index];
+        return wrap(elements[index]);
+    }
+
+    bool next(size_t& index, $union& element) override {
+        if (index >= elements.size()) return false;
+        element = wrap(elements[index++]);
+        return true;
     }
 
     void add($union element) override {
-        elements.push_back(element);
+        elements.push_back(unwrap(element));
     }
 
     auto find($union element) {
-        Equator equator{type == ScalarTypeKind::FLOAT ? IdentityKind::FLOAT : IdentityKind::SELF};
-        return std::find_if(elements.begin(), elements.end(),
-                            [element, equator]($union element0){ return equator(element0, element); });
+        return elements.begin() + Search::find(elements.data(), elements.size(), unwrap(element));
     }
 
     void remove($union element) override {
-        elements.erase(find(element));
+        if (auto it = find(element); it != elements.end()) elements.erase(it);
     }
 
     bool contains($union element) override {
@@ -653,10 +972,10 @@ struct ScalarList : List {
 
     struct ScalarListIterator : Iterator {
         ScalarList* list;
-        std::vector<$union>::iterator first, last;
+        size_t index = 0;
 
-        explicit ScalarListIterator(ScalarList* list): list(list), first(list->elements.begin()), last(list->elements.end()) {
-            E = std::make_shared<ScalarType>(list->type);
+        explicit ScalarListIterator(ScalarList* list): list(list) {
+            E = ScalarTypes::of(kind);
         }
 
         void walkMark() override {
@@ -664,8 +983,8 @@ struct ScalarList : List {
         }
 
         bool move() override {
-            if (first != last) {
-                cache = *first++;
+            if (index < list->elements.size()) {
+                cache = wrap(list->elements[index++]);
                 return true;
             }
             return false;
@@ -674,10 +993,18 @@ struct ScalarList : List {
         bool equals(Object *other) override;
     };
 
-    Iterator * iterator() override {
+    Iterator * iterator(VM* vm) override {
         return vm->newObject<ScalarListIterator>(this);
     }
 
+    size_t bytes() override {
+        return sizeof(ScalarList) + elements.capacity() * sizeof(T);
+    }
+
+    void compact() override {
+        shrink(elements);
+    }
+
     std::string toString() override;
 
     bool equals(Object *other) override;
@@ -685,25 +1012,41 @@ struct ScalarList : List {
     size_t hashCode() override;
 };
 
+using IntList = ScalarList<int64_t>;
+using FloatList = ScalarList<double>;
+using CharList = ScalarList<char32_t>;
+
+extern template struct ScalarList<int64_t>;
+extern template struct ScalarList<double>;
+extern template struct ScalarList<char32_t>;
+
 struct Set : Collection {
-    using underlying = std::unordered_set<$union, Hasher, Equator>;
+    using underlying = FlatTable<$union>;
     underlying elements;
     std::shared_ptr<SetType> prototype;
+    std::atomic<bool> pinned = false;
 
     Set(underlying elements, std::shared_ptr<SetType> prototype)
         : elements(std::move(elements)), prototype(std::move(prototype)) {}
 
     void walkMark() override {
         if (isValueBased(prototype->E)) return;
-        for (auto&& element : elements) {
-            element.$object->mark();
+        if (markChunked(this, elements.capacity())) return;
+        walkMarkChunk(0, elements.capacity());
+    }
+
+    void walkMarkChunk(size_t first, size_t last) override {
+        for (; first < last; ++first) {
+            if (elements.occupied(first)) {
+                elements.slot(first).$object->mark();
+            }
         }
     }
 
     TypeReference getType() override { return prototype; }
 
     void add($union element) override {
-        elements.insert(element);
+        elements.emplace(element);
     }
 
     void remove($union element) override {
@@ -720,19 +1063,21 @@ struct Set : Collection {
 
     struct SetIterator : Iterator {
         Set* set;
-        underlying::iterator first, last;
+        size_t index = 0;
 
-        explicit SetIterator(Set* set): set(set), first(set->elements.begin()), last(set->elements.end()) {
+        explicit SetIterator(Set* set): set(set) {
             E = set->prototype->E;
         }
 
         void walkMark() override {
             set->mark();
+            set->pinned.store(true, std::memory_order_relaxed);
         }
 
         bool move() override {
-            if (first != last) {
-                cache = *first++;
+            index = set->elements.next(index);
+            if (index < set->elements.capacity()) {
+                cache = set->elements.slot(index++);
                 return true;
             }
             return false;
@@ -741,10 +1086,20 @@ struct Set : Collection {
         bool equals(Object *other) override;
     };
 
-    Iterator * iterator() override {
+    Iterator * iterator(VM* vm) override {
         return vm->newObject<SetIterator>(this);
     }
 
+    size_t bytes() override {
+        return sizeof(Set) + elements.capacity() * (1 + sizeof($union));
+    }
+
+    // Rehashing would reorder the elements under the iterators found alive during marking.
+    void compact() override {
+        if (pinned.exchange(false, std::memory_order_relaxed)) return;
+        if (elements.capacity() > 4 * elements.size() + 16) elements.shrink();
+    }
+
     std::string toString() override;
 
     bool equals(Object *other) override;
@@ -757,7 +1112,10 @@ struct NoneSet : Collection {
 
     explicit NoneSet(bool state): state(state) {}
 
-    TypeReference getType() override { return std::make_shared<SetType>(ScalarTypes::NONE); }
+    TypeReference getType() override {
+        static const TypeReference type = intern(std::make_shared<SetType>(ScalarTypes::NONE));
+        return type;
+    }
 
     void add($union element) override {
         state = true;
@@ -797,7 +1155,7 @@ struct NoneSet : Collection {
         bool equals(Object *other) override;
     };
 
-    Iterator * iterator() override {
+    Iterator * iterator(VM* vm) override {
         return vm->newObject<NoneSetIterator>(this);
     }
 
@@ -814,7 +1172,10 @@ struct BoolSet : Collection {
 
     BoolSet(): falseState(false), trueState(false) {}
 
-    TypeReference getType() override { return std::make_shared<SetType>(ScalarTypes::BOOL); }
+    TypeReference getType() override {
+        static const TypeReference type = intern(std::make_shared<SetType>(ScalarTypes::BOOL));
+        return type;
+    }
 
     void add($union element) override {
         (element.$bool ? trueState : falseState) = true;
@@ -861,7 +1222,7 @@ struct BoolSet : Collection {
         bool equals(Object *other) override;
     };
 
-    Iterator * iterator() override {
+    Iterator * iterator(VM* vm) override {
         return vm->newObject<BoolSetIterator>(this);
     }
 
@@ -877,7 +1238,10 @@ struct ByteSet : Collection {
 
     ByteSet() = default;
 
-    TypeReference getType() override { return std::make_shared<SetType>(ScalarTypes::BYTE); }
+    TypeReference getType() override {
+        static const TypeReference type = intern(std::make_shared<SetType>(ScalarTypes::BYTE));
+        return type;
+    }
 
     void add($union element) override {
         set.set(element.$byte);
@@ -920,7 +1284,7 @@ struct ByteSet : Collection {
         bool equals(Object *other) override;
     };
 
-    Iterator * iterator() override {
+    Iterator * iterator(VM* vm) override {
         return vm->newObject<ByteSetIterator>(this);
     }
 
@@ -931,25 +1295,56 @@ struct ByteSet : Collection {
     size_t hashCode() override;
 };
 
+// An iterator over the entries of a dict, which a for loop steps without materializing each entry as a pair
+struct EntryIterator : Iterator {
+    VM* vm;
+    TypeReference K, V;
+
+    EntryIterator(VM* vm, DictType const& prototype): vm(vm), K(prototype.K), V(prototype.V) {
+        E = std::make_shared<TupleType>(std::vector{K, V});
+    }
+
+    // steps to the next entry
+    virtual bool advance() = 0;
+
+    // the entry advanced to
+    virtual std::pair<$union, $union> entry() = 0;
+
+    bool move() override {
+        if (!advance()) return false;
+        auto [key, value] = entry();
+        cache = vm->newObject<Pair>(key, value, K, V);
+        return true;
+    }
+};
+
 struct Dict : Collection {
-    using underlying = std::unordered_map<$union, $union, Hasher, Equator>;
+    using underlying = FlatTable<std::pair<$union, $union>>;
     underlying elements;
     std::shared_ptr<DictType> prototype;
+    std::atomic<bool> pinned = false;
 
     Dict(underlying elements, std::shared_ptr<DictType> prototype)
         : elements(std::move(elements)), prototype(std::move(prototype)) {}
 
     void walkMark() override {
+        if (isValueBased(prototype->K) && isValueBased(prototype->V)) return;
+        if (markChunked(this, elements.capacity())) return;
+        walkMarkChunk(0, elements.capacity());
+    }
+
+    void walkMarkChunk(size_t first, size_t last) override {
         auto k = isValueBased(prototype->K);
         auto v = isValueBased(prototype->V);
-        if (k && v) return;
-        for (auto&& [key, value] : elements) {
-             if (!k) {
-                 key.$object->mark();
-             }
-             if (!v) {
-                 value.$object->mark();
-             }
+        for (; first < last; ++first) {
+            if (!elements.occupied(first)) continue;
+            auto&& [key, value] = elements.slot(first);
+            if (!k) {
+                key.$object->mark();
+            }
+            if (!v) {
+                value.$object->mark();
+            }
         }
     }
 
@@ -957,7 +1352,7 @@ struct Dict : Collection {
 
     void add($union element) override {
         auto pair = dynamic_cast<Pair*>(element.$object);
-        elements.insert_or_assign(pair->first, pair->second);
+        elements.emplace(pair->first).second = pair->second;
     }
 
     void remove($union element) override {
@@ -972,24 +1367,171 @@ struct Dict : Collection {
         return elements.size();
     }
 
-    struct DictIterator : Iterator {
+    struct DictIterator : EntryIterator {
         Dict* dict;
-        underlying::iterator first, last;
+        size_t index = 0;
+
+        explicit DictIterator(VM* vm, Dict* dict): EntryIterator(vm, *dict->prototype), dict(dict) {}
+
+        void walkMark() override;
+
+        bool advance() override {
+            index = dict->elements.next(index);
+            if (index < dict->elements.capacity()) {
+                ++index;
+                return true;
+            }
+            return false;
+        }
 
-        explicit DictIterator(Dict* dict): dict(dict), first(dict->elements.begin()), last(dict->elements.end()) {
-            E = std::make_shared<TupleType>(std::vector{dict->prototype->K, dict->prototype->V});
+        std::pair<$union, $union> entry() override {
+            return dict->elements.slot(index - 1);
+        }
+
+        bool equals(Object *other) override;
+    };
+
+    Iterator * iterator(VM* vm) override {
+        return vm->newObject<DictIterator>(vm, this);
+    }
+
+    size_t bytes() override {
+        return sizeof(Dict) + elements.capacity() * (1 + 2 * sizeof($union));
+    }
+
+    // Rehashing would reorder the elements under the iterators found alive during marking.
+    void compact() override {
+        if (pinned.exchange(false, std::memory_order_relaxed)) return;
+        if (elements.capacity() > 4 * elements.size() + 16) elements.shrink();
+    }
+
+    std::string toString() override;
+
+    bool equals(Object *other) override;
+
+    size_t hashCode() override;
+
+};
+
+// A dict holding its values weakly, whose entries are dropped by the collector once nothing else references their values.
+// Its values are always objects, while its keys are kept alive as usual.
+struct WeakDict : Dict {
+    using Dict::Dict;
+
+    void walkMark() override {
+        markWeak(this);
+        if (isValueBased(prototype->K)) return;
+        if (markChunked(this, elements.capacity())) return;
+        walkMarkChunk(0, elements.capacity());
+    }
+
+    void walkMarkChunk(size_t first, size_t last) override {
+        for (; first < last; ++first) {
+            if (elements.occupied(first)) {
+                elements.slot(first).first.$object->mark();
+            }
+        }
+    }
+};
+
+// Collections sharing structure with their snapshots, so that taking a snapshot costs O(1) and an update O(log n).
+// An update never shows through another snapshot, nor through an iterator taken before it.
+
+struct PersistentList : List {
+    PersistentVector elements;
+    std::shared_ptr<ListType> prototype;
+    size_t mask; // the bytes meaningful to a scalar element
+
+    PersistentList(PersistentVector elements, std::shared_ptr<ListType> prototype)
+        : elements(std::move(elements)), prototype(std::move(prototype)), mask(maskOf(this->prototype->E)) {}
+
+    static size_t maskOf(TypeReference const& E) {
+        if (auto scalar = dynamic_cast<ScalarType*>(E.get())) {
+            switch (scalar->S) {
+                case ScalarTypeKind::NONE: return 0;
+                case ScalarTypeKind::BOOL: return 0xFF;
+                case ScalarTypeKind::BYTE: return 0xFF;
+                case ScalarTypeKind::CHAR: return 0xFFFFFFFF;
+                default: break;
+            }
+        }
+        return -1;
+    }
+
+    // clears the upper bytes of a scalar, so that equal elements are equal as a whole
+    [[nodiscard]] $union canonical($union element) const {
+        return element.$size & mask;
+    }
+
+    void walkMark() override {
+        if (isValueBased(prototype->E)) return;
+        elements.forEach([]($union element) { element.$object->mark(); });
+    }
+
+    TypeReference getType() override { return prototype; }
+
+    $union load(size_t index) override {
+        return elements[index];
+    }
+
+    void store(size_t index, $union element) override {
+        elements.set(index, canonical(element));
+    }
+
+    bool next(size_t& index, $union& element) override {
+        if (index >= elements.size()) return false;
+        element = elements[index++];
+        return true;
+    }
+
+    bool holdsObjects() override {
+        return !isValueBased(prototype->E);
+    }
+
+    void add($union element) override {
+        elements.push(canonical(element));
+    }
+
+    size_t find($union element) {
+        Equator equator{getIdentityKind(prototype->E)};
+        element = canonical(element);
+        size_t index = 0;
+        while (index < elements.size() && !equator(elements[index], element)) ++index;
+        return index;
+    }
+
+    bool contains($union element) override {
+        return find(element) < elements.size();
+    }
+
+    void remove($union element) override {
+        if (size_t index = find(element); index < elements.size()) elements.erase(index);
+    }
+
+    size_t size() override {
+        return elements.size();
+    }
+
+    struct PersistentListIterator : Iterator {
+        PersistentList* list;
+        PersistentVector elements;
+        size_t index = 0;
+        const $union* leaf = nullptr;
+
+        explicit PersistentListIterator(PersistentList* list): list(list), elements(list->elements) {
+            E = list->prototype->E;
         }
 
         void walkMark() override {
-            dict->mark();
-            if (cache.has_value())
-                cache->$object->mark();
+            list->mark();
+            if (isValueBased(E) || elements.shares(list->elements)) return;
+            elements.forEach([]($union element) { element.$object->mark(); });
         }
 
         bool move() override {
-            if (first != last) {
-                auto [key, value] = *first++;
-                cache = vm->newObject<Pair>(key, value, dict->prototype->K, dict->prototype->V);
+            if (index < elements.size()) {
+                if ((index & Trie::MASK) == 0) leaf = elements.leaf(index);
+                cache = leaf[index++ & Trie::MASK];
                 return true;
             }
             return false;
@@ -998,8 +1540,95 @@ struct Dict : Collection {
         bool equals(Object *other) override;
     };
 
-    Iterator * iterator() override {
-        return vm->newObject<DictIterator>(this);
+    Iterator * iterator(VM* vm) override {
+        return vm->newObject<PersistentListIterator>(this);
+    }
+
+    size_t bytes() override {
+        return sizeof(PersistentList) + elements.size() * sizeof($union);
+    }
+
+    std::string toString() override;
+
+    bool equals(Object *other) override;
+
+    size_t hashCode() override;
+};
+
+struct PersistentDict : Collection {
+    PersistentMap elements;
+    std::shared_ptr<DictType> prototype;
+
+    PersistentDict(PersistentMap elements, std::shared_ptr<DictType> prototype)
+        : elements(std::move(elements)), prototype(std::move(prototype)) {}
+
+    void walkMark() override {
+        markEntries(elements);
+    }
+
+    // marks the objects within a version of the entries
+    void markEntries(PersistentMap const& version) const {
+        auto k = isValueBased(prototype->K);
+        auto v = isValueBased(prototype->V);
+        if (k && v) return;
+        version.forEach([k, v]($union key, $union value) {
+            if (!k) {
+                key.$object->mark();
+            }
+            if (!v) {
+                value.$object->mark();
+            }
+        });
+    }
+
+    TypeReference getType() override { return prototype; }
+
+    void add($union element) override {
+        auto pair = dynamic_cast<Pair*>(element.$object);
+        elements.assign(pair->first, pair->second);
+    }
+
+    void remove($union element) override {
+        elements.erase(element);
+    }
+
+    bool contains($union element) override {
+        return elements.contains(element);
+    }
+
+    size_t size() override {
+        return elements.size();
+    }
+
+    struct PersistentDictIterator : EntryIterator {
+        PersistentDict* dict;
+        PersistentMap elements;
+        PersistentMap::Cursor cursor;
+        const PersistentMap::Entry* current = nullptr;
+
+        explicit PersistentDictIterator(VM* vm, PersistentDict* dict)
+            : EntryIterator(vm, *dict->prototype), dict(dict), elements(dict->elements), cursor(elements.cursor()) {}
+
+        void walkMark() override;
+
+        bool advance() override {
+            current = cursor.next();
+            return current;
+        }
+
+        std::pair<$union, $union> entry() override {
+            return {current->key, current->value};
+        }
+
+        bool equals(Object *other) override;
+    };
+
+    Iterator * iterator(VM* vm) override {
+        return vm->newObject<PersistentDictIterator>(vm, this);
+    }
+
+    size_t bytes() override {
+        return sizeof(PersistentDict) + elements.size() * sizeof(PersistentMap::Entry);
     }
 
     std::string toString() override;
@@ -1007,7 +1636,193 @@ struct Dict : Collection {
     bool equals(Object *other) override;
 
     size_t hashCode() override;
+};
+
+// Lazy combinators stepping their sources natively, without intermediate collections or coroutine frames
+
+struct RangeIterator : Iterator {
+    int64_t next, end, step;
+
+    RangeIterator(int64_t next, int64_t end, int64_t step): next(next), end(end), step(step) {
+        E = ScalarTypes::INT;
+    }
+
+    bool move() override {
+        if (step > 0 ? next >= end : next <= end) return false;
+        cache = next;
+        if (__builtin_add_overflow(next, step, &next)) next = end;
+        return true;
+    }
+};
+
+struct MapIterator : Iterator {
+    VM* vm;
+    Assembly* assembly;
+    Iterator* source;
+    Func* func;
+
+    MapIterator(VM* vm, Assembly* assembly, Iterator* source, Func* func)
+        : vm(vm), assembly(assembly), source(source), func(func) {
+        E = func->prototype->R;
+    }
 
+    void walkMark() override {
+        source->mark();
+        func->mark();
+        if (cache.has_value() && !isValueBased(E))
+            cache->$object->mark();
+    }
+
+    bool move() override {
+        if (!source->move()) return false;
+        auto captures = func->captures;
+        captures.push_back(source->get());
+        cache = call(assembly, vm, func->func, std::move(captures));
+        return true;
+    }
+};
+
+struct FilterIterator : Iterator {
+    VM* vm;
+    Assembly* assembly;
+    Iterator* source;
+    Func* func;
+
+    FilterIterator(VM* vm, Assembly* assembly, Iterator* source, Func* func)
+        : vm(vm), assembly(assembly), source(source), func(func) {
+        E = source->E;
+    }
+
+    void walkMark() override {
+        source->mark();
+        func->mark();
+    }
+
+    bool move() override {
+        while (source->move()) {
+            auto element = source->get();
+            auto captures = func->captures;
+            captures.push_back(element);
+            if (call(assembly, vm, func->func, std::move(captures)).$bool) {
+                cache = element;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+struct TakeIterator : Iterator {
+    Iterator* source;
+    int64_t remaining;
+
+    TakeIterator(Iterator* source, int64_t remaining): source(source), remaining(remaining) {
+        E = source->E;
+    }
+
+    void walkMark() override {
+        source->mark();
+    }
+
+    bool move() override {
+        if (remaining <= 0 || !source->move()) return false;
+        --remaining;
+        cache = source->get();
+        return true;
+    }
+};
+
+struct SkipIterator : Iterator {
+    Iterator* source;
+    int64_t skipped;
+
+    SkipIterator(Iterator* source, int64_t skipped): source(source), skipped(skipped) {
+        E = source->E;
+    }
+
+    void walkMark() override {
+        source->mark();
+    }
+
+    bool move() override {
+        for (; skipped > 0; --skipped) {
+            if (!source->move()) return false;
+        }
+        if (!source->move()) return false;
+        cache = source->get();
+        return true;
+    }
+};
+
+struct ZipIterator : Iterator {
+    VM* vm;
+    Iterator* first;
+    Iterator* second;
+
+    ZipIterator(VM* vm, Iterator* first, Iterator* second): vm(vm), first(first), second(second) {
+        E = intern(std::make_shared<TupleType>(std::vector{first->E, second->E}));
+    }
+
+    void walkMark() override {
+        first->mark();
+        second->mark();
+        if (cache.has_value())
+            cache->$object->mark();
+    }
+
+    bool move() override {
+        if (!first->move() || !second->move()) return false;
+        cache = vm->newObject<Pair>(first->get(), second->get(), first->E, second->E);
+        return true;
+    }
+};
+
+struct EnumerateIterator : Iterator {
+    VM* vm;
+    Iterator* source;
+    int64_t index = 0;
+
+    EnumerateIterator(VM* vm, Iterator* source): vm(vm), source(source) {
+        E = intern(std::make_shared<TupleType>(std::vector{ScalarTypes::INT, source->E}));
+    }
+
+    void walkMark() override {
+        source->mark();
+        if (cache.has_value())
+            cache->$object->mark();
+    }
+
+    bool move() override {
+        if (!source->move()) return false;
+        cache = vm->newObject<Pair>(index++, source->get(), ScalarTypes::INT, source->E);
+        return true;
+    }
+};
+
+struct ChainIterator : Iterator {
+    Iterator* first;
+    Iterator* second;
+
+    ChainIterator(Iterator* first, Iterator* second): first(first), second(second) {
+        E = first->E;
+    }
+
+    void walkMark() override {
+        first->mark();
+        second->mark();
+    }
+
+    bool move() override {
+        if (first->move()) {
+            cache = first->get();
+            return true;
+        }
+        if (second->move()) {
+            cache = second->get();
+            return true;
+        }
+        return false;
+    }
 };
 
 struct Coroutine : Iterator {
@@ -4,19 +4,19 @@ true
 true
 3
 5
-2762169579135187400
-@[2, 1, 0]
-@[2, 0]
+1019145960556548909
+@[0, 2, 1]
+@[0, 2]
 true
 true
 2
-@[2: c, 1: b, 0: d]
-@[2: c, 0: d]
+@[0: d, 2: c, 1: b]
+@[0: d, 2: c]
 true
 true
 2
 b
-@[1: c, 0: b]
+@[0: b, 1: c]
 1
 2
 3
@@ -0,0 +1,8 @@
+tuples 4096 2569
+lists 4096 2588
+strings 4096 2567
+ints 4096 2613
+false
+true true false
+1000 427
+Exited with returned object: ()
\ No newline at end of file
@@ -0,0 +1,2 @@
+20000 kept 19999 400000
+Exited with returned object: ()
\ No newline at end of file
@@ -0,0 +1,7 @@
+3 9 15 21 27 
+0:one 1:two 
+zeroa oneb twoc threed 
+10 6 2 0 4 8 
+dict 1
+4333
+Exited with returned object: ()
\ No newline at end of file
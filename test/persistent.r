@@ -0,0 +1,8 @@
+[0, 3, 4] [1, 2, 3] false true
+1003 503 497 998
+2 [1] false true [2]
+true true true true true
+false false false
+true true true
+abc déf défg
+Exited with returned object: ()
\ No newline at end of file
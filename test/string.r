@@ -0,0 +1,9 @@
+name: porkchop
+language: C++
+description: a tiny statically typed scripting language
+tiny statically typed scripting language
+18 -1
+3890 1001 999
+7,278,279,280,281,28
+123456789012345678 0123456789012345
+Exited with returned object: ()
\ No newline at end of file
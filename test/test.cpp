@@ -4,6 +4,8 @@
 
 int main(int argc, const char* argv[]) {
     Porkchop::forceUTF8();
+    Porkchop::VM vm;
+    Porkchop::configure(vm, argc, argv);
     const int argi = 2;
     if (argc < argi) {
         Porkchop::Error error;
@@ -24,7 +26,6 @@ int main(int argc, const char* argv[]) {
     std::ignore = compiler.descriptor(); // for coverage
     Porkchop::Interpretation interpretation(&continuum);
     compiler.compile(&interpretation);
-    Porkchop::VM vm;
     vm.init(argi, argc, argv);
     auto ret = Porkchop::execute(&vm, &interpretation);
     auto type = compiler.continuum->functions.back()->prototype()->R;
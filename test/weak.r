@@ -0,0 +1,5 @@
+100 true
+1 false true
+[42, 1764]
+0 [42, 1764]
+Exited with returned object: ()
\ No newline at end of file
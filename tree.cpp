@@ -1,5 +1,8 @@
 #include <cmath>
+#include <unordered_set>
+#include <limits>
 #include "tree.hpp"
+#include "function.hpp"
 #include "assembler.hpp"
 #include "diagnostics.hpp"
 #include "lexer.hpp"
@@ -47,6 +50,11 @@ void assignable(TypeReference const& type, TypeReference const& expected, Segmen
     }
 }
 
+void Expr::walkDiscardedBytecode(Assembler* assembler) const {
+    walkBytecode(assembler);
+    assembler->opcode(Opcode::POP);
+}
+
 void Expr::neverGonnaGiveYouUp(const char* msg) const {
     Porkchop::neverGonnaGiveYouUp(getType(), msg, segment());
 }
@@ -232,7 +240,7 @@ TypeReference PrefixExpr::evalType(TypeReference const& infer) const {
             return ScalarTypes::INT;
         case TokenType::OP_AND:
             if (auto element = elementof(type)) {
-                return std::make_shared<IterType>(element);
+                return intern(std::make_shared<IterType>(element));
             }
             rhs->expect("iterable type");
             break;
@@ -318,6 +326,9 @@ void PrefixExpr::walkBytecode(Assembler* assembler) const {
             break;
         case TokenType::OP_ATAT:
             switch (getIdentityKind(type)) {
+                case IdentityKind::SELF:
+                    assembler->opcode(Opcode::IHASH);
+                    break;
                 case IdentityKind::FLOAT:
                     assembler->opcode(Opcode::FHASH);
                     break;
@@ -858,6 +869,84 @@ void AssignExpr::walkBytecode(Assembler* assembler) const {
     }
 }
 
+namespace {
+
+// Whether stores into the leaves of lhs are independent of each other and of their order
+bool distinctLocals(Expr const* lhs, std::unordered_set<size_t>& indices) {
+    if (auto tuple = dynamic_cast<TupleExpr const*>(lhs)) {
+        return std::all_of(tuple->elements.begin(), tuple->elements.end(), [&indices](auto&& element) {
+            return distinctLocals(element.get(), indices);
+        });
+    }
+    if (auto id = dynamic_cast<IdExpr const*>(lhs)) {
+        return id->lookup.scope == LocalContext::LookupResult::Scope::NONE || indices.insert(id->lookup.index).second;
+    }
+    return false;
+}
+
+// Pushes the leaves of rhs matching the shape of lhs, without constructing the tuples in between
+template<typename Target>
+void walkFlattened(Target const* lhs, Expr const* rhs, Assembler* assembler) {
+    auto tuple = dynamic_cast<TupleExpr const*>(rhs);
+    if constexpr (std::is_same_v<Target, Declarator>) {
+        auto declarator = dynamic_cast<TupleDeclarator const*>(lhs);
+        if (declarator && tuple) {
+            for (size_t i = 0; i < tuple->elements.size(); ++i) {
+                walkFlattened(declarator->elements[i].get(), tuple->elements[i].get(), assembler);
+            }
+            return;
+        }
+    } else {
+        auto target = dynamic_cast<TupleExpr const*>(lhs);
+        if (target && tuple) {
+            for (size_t i = 0; i < tuple->elements.size(); ++i) {
+                walkFlattened(target->elements[i].get(), tuple->elements[i].get(), assembler);
+            }
+            return;
+        }
+    }
+    rhs->walkBytecode(assembler);
+}
+
+// Stores the leaves pushed by walkFlattened in reverse, leaving nothing on the stack
+template<typename Target>
+void walkFlattenedStore(Target const* lhs, Expr const* rhs, Assembler* assembler) {
+    auto tuple = dynamic_cast<TupleExpr const*>(rhs);
+    if constexpr (std::is_same_v<Target, Declarator>) {
+        auto declarator = dynamic_cast<TupleDeclarator const*>(lhs);
+        if (declarator && tuple) {
+            for (size_t i = tuple->elements.size(); i-- > 0;) {
+                walkFlattenedStore(declarator->elements[i].get(), tuple->elements[i].get(), assembler);
+            }
+            return;
+        }
+        lhs->walkBytecode(assembler);
+    } else {
+        auto target = dynamic_cast<TupleExpr const*>(lhs);
+        if (target && tuple) {
+            for (size_t i = tuple->elements.size(); i-- > 0;) {
+                walkFlattenedStore(target->elements[i].get(), tuple->elements[i].get(), assembler);
+            }
+            return;
+        }
+        dynamic_cast<AssignableExpr const*>(lhs)->walkStoreBytecode(assembler);
+    }
+    assembler->opcode(Opcode::POP);
+}
+
+}
+
+void AssignExpr::walkDiscardedBytecode(Assembler* assembler) const {
+    std::unordered_set<size_t> indices;
+    // optimization: a tuple assigned to a tuple of locals is never materialized
+    if (token.type == TokenType::OP_ASSIGN && dynamic_cast<TupleExpr*>(rhs.get()) && distinctLocals(lhs.get(), indices)) {
+        walkFlattened<Expr>(lhs.get(), rhs.get(), assembler);
+        walkFlattenedStore<Expr>(lhs.get(), rhs.get(), assembler);
+    } else {
+        Expr::walkDiscardedBytecode(assembler);
+    }
+}
+
 TypeReference AccessExpr::evalType(TypeReference const& infer) const {
     TypeReference type1 = lhs->getType();
     if (auto tuple = dynamic_cast<TupleType*>(type1.get())) {
@@ -940,6 +1029,21 @@ TypeReference InvokeExpr::evalType(TypeReference const& infer) const {
 }
 
 void InvokeExpr::walkBytecode(Assembler* assembler) const {
+    // optimization: a lambda invoked right away takes its captures as leading arguments, and no closure is allocated.
+    // Captures are loaded before the arguments, so arguments are restricted to those not assigning any local.
+    if (auto lambda = dynamic_cast<LambdaExpr*>(lhs.get()); lambda && !lambda->captures.empty()
+        && std::all_of(rhs.begin(), rhs.end(), [](auto&& e) { return e->isConst() || dynamic_cast<IdExpr*>(e.get()); })) {
+        for (auto&& e : lambda->captures) {
+            e->walkBytecode(assembler);
+        }
+        for (auto& e : rhs) {
+            e->walkBytecode(assembler);
+        }
+        assembler->indexed(Opcode::FCONST, lambda->index);
+        assembler->indexed(Opcode::BIND, lambda->captures.size() + rhs.size());
+        assembler->opcode(Opcode::CALL);
+        return;
+    }
     for (auto& e : rhs) {
         e->walkBytecode(assembler);
     }
@@ -961,7 +1065,7 @@ TypeReference DotExpr::evalType(TypeReference const& infer) const {
             error.with(ErrorMessage().note(rhs->segment()).text("type of this function is").type(rhs->getType()));
             error.raise();
         }
-        return std::make_shared<FuncType>(std::vector<TypeReference>{std::next(func->P.begin()), func->P.end()},func->R);
+        return intern(std::make_shared<FuncType>(std::vector<TypeReference>{std::next(func->P.begin()), func->P.end()},func->R));
     }
     rhs->expect("invocable type");
 }
@@ -990,7 +1094,7 @@ TypeReference BindExpr::evalType(TypeReference const& infer) const {
         }
         auto P = func->P;
         P.erase(P.begin(), P.begin() + rhs.size());
-        return std::make_shared<FuncType>(std::move(P), func->R);
+        return intern(std::make_shared<FuncType>(std::move(P), func->R));
     }
     lhs->expect("invocable type");
 }
@@ -1097,7 +1201,7 @@ TypeReference TupleExpr::evalType(TypeReference const& infer) const {
     for (size_t i = 0; i < elements.size(); ++i) {
         E.push_back(elements[i]->getType(tuple == nullptr ? nullptr : tuple->E[i]));
     }
-    return std::make_shared<TupleType>(std::move(E));
+    return intern(std::make_shared<TupleType>(std::move(E)));
 }
 
 void TupleExpr::walkBytecode(Assembler* assembler) const {
@@ -1136,7 +1240,7 @@ TypeReference ListExpr::evalType(TypeReference const& infer) const {
             return infer;
         raise("element type is unspecified for this list", segment());
     }
-    return std::make_shared<ListType>(ensureElements(elements, segment(), "as elements of a list"));
+    return intern(std::make_shared<ListType>(ensureElements(elements, segment(), "as elements of a list")));
 }
 
 void ListExpr::walkBytecode(Assembler* assembler) const {
@@ -1152,7 +1256,7 @@ TypeReference SetExpr::evalType(TypeReference const& infer) const {
             return infer;
         raise("element type is unspecified for this set or dict", segment());
     }
-    return std::make_shared<SetType>(ensureElements(elements, segment(), "as elements of a set"));
+    return intern(std::make_shared<SetType>(ensureElements(elements, segment(), "as elements of a set")));
 }
 
 void SetExpr::walkBytecode(Assembler* assembler) const {
@@ -1167,8 +1271,8 @@ void SetExpr::walkBytecode(Assembler* assembler) const {
 }
 
 TypeReference DictExpr::evalType(TypeReference const& infer) const {
-    return std::make_shared<DictType>(ensureElements(keys, segment(), "as keys of a dict"),
-                                      ensureElements(values, segment(), "as values of a dict"));
+    return intern(std::make_shared<DictType>(ensureElements(keys, segment(), "as keys of a dict"),
+                                             ensureElements(values, segment(), "as values of a dict")));
 }
 
 void DictExpr::walkBytecode(Assembler* assembler) const {
@@ -1206,11 +1310,19 @@ void ClauseExpr::walkBytecode(Assembler* assembler) const {
     if (lines.empty()) {
         assembler->const0();
     } else {
-        bool first = true;
-        for (auto&& line : lines) {
-            if (first) { first = false; } else { assembler->opcode(Opcode::POP); }
-            line->walkBytecode(assembler);
+        for (size_t i = 0; i + 1 < lines.size(); ++i) {
+            assembler->line(lines[i]->segment().line1);
+            lines[i]->walkDiscardedBytecode(assembler);
         }
+        assembler->line(lines.back()->segment().line1);
+        lines.back()->walkBytecode(assembler);
+    }
+}
+
+void ClauseExpr::walkDiscardedBytecode(Assembler* assembler) const {
+    for (auto&& line : lines) {
+        assembler->line(line->segment().line1);
+        line->walkDiscardedBytecode(assembler);
     }
 }
 
@@ -1235,6 +1347,18 @@ void IfElseExpr::walkBytecode(Assembler* assembler) const {
     walkBytecode(cond.get(), lhs.get(), rhs.get(), compiler, assembler);
 }
 
+void IfElseExpr::walkDiscardedBytecode(Assembler* assembler) const {
+    size_t A = compiler.continuum->labelUntil++;
+    size_t B = compiler.continuum->labelUntil++;
+    cond->walkBytecode(assembler);
+    assembler->labeled(Opcode::JMP0, A);
+    lhs->walkDiscardedBytecode(assembler);
+    assembler->labeled(Opcode::JMP, B);
+    assembler->label(A);
+    rhs->walkDiscardedBytecode(assembler);
+    assembler->label(B);
+}
+
 void IfElseExpr::walkBytecode(Expr const* cond, Expr const* lhs, Expr const* rhs, Compiler& compiler, Assembler* assembler) {
     size_t A = compiler.continuum->labelUntil++;
     size_t B = compiler.continuum->labelUntil++;
@@ -1264,18 +1388,21 @@ TypeReference WhileExpr::evalType(TypeReference const& infer) const {
     return ScalarTypes::NONE;
 }
 
-void WhileExpr::walkBytecode(Assembler* assembler) const {
+void LoopExpr::walkBytecode(Assembler* assembler) const {
+    walkDiscardedBytecode(assembler);
+    assembler->const0();
+}
+
+void WhileExpr::walkDiscardedBytecode(Assembler* assembler) const {
     size_t A = compiler.continuum->labelUntil++;
     size_t B = compiler.continuum->labelUntil++;
     breakpoint = B;
     assembler->label(A);
     cond->walkBytecode(assembler);
     assembler->labeled(Opcode::JMP0, B);
-    clause->walkBytecode(assembler);
-    assembler->opcode(Opcode::POP);
+    clause->walkDiscardedBytecode(assembler);
     assembler->labeled(Opcode::JMP, A);
     assembler->label(B);
-    assembler->const0();
 }
 
 TypeReference ReturnExpr::evalType(TypeReference const& infer) const {
@@ -1340,7 +1467,7 @@ void TupleDeclarator::infer(TypeReference type) {
             elements[i]->infer(tuple->E[i]);
             types.push_back(elements[i]->typeCache);
         }
-        typeCache = std::make_shared<TupleType>(std::move(types));
+        typeCache = intern(std::make_shared<TupleType>(std::move(types)));
     } else {
         Error()
         .with(ErrorMessage().error(segment).text("expected a tuple type but got").type(typeCache))
@@ -1372,31 +1499,168 @@ void LetExpr::walkBytecode(Assembler *assembler) const {
     declarator->walkBytecode(assembler);
 }
 
+void LetExpr::walkDiscardedBytecode(Assembler *assembler) const {
+    // optimization: a tuple destructured right away is never materialized
+    walkFlattened<Declarator>(declarator.get(), initializer.get(), assembler);
+    walkFlattenedStore<Declarator>(declarator.get(), initializer.get(), assembler);
+}
+
 TypeReference ForExpr::evalType(TypeReference const& infer) const {
     if (isNever(clause->getType())) return ScalarTypes::NEVER;
     return ScalarTypes::NONE;
 }
 
-void ForExpr::walkBytecode(Assembler *assembler) const {
+// the call of the external range(a, b, step) initializing a loop, if the step is a non-zero constant
+const InvokeExpr* ForExpr::countedRange(const Expr* initializer) {
+    auto invoke = dynamic_cast<const InvokeExpr*>(initializer);
+    if (!invoke) return nullptr;
+    auto id = dynamic_cast<IdExpr*>(invoke->lhs.get());
+    if (!id || id->lookup.scope != LocalContext::LookupResult::Scope::FUNCTION || invoke->compiler.of(id->token) != "range") return nullptr;
+    if (!dynamic_cast<ExternalFunctionReference*>(invoke->compiler.continuum->functions[id->lookup.index].get())) return nullptr;
+    if (!invoke->rhs[2]->isConst() || invoke->rhs[2]->requireConst().$int == 0) return nullptr;
+    return invoke;
+}
+
+ForExpr::Layout ForExpr::declare(LocalContext& context, Declarator* declarator, const Expr* initializer) {
+    Layout layout{};
+    auto type = initializer->getType();
+    if (countedRange(initializer)) {
+        layout.lowering = Layout::Lowering::RANGE;
+        layout.state = context.hidden(ScalarTypes::INT);
+        context.hidden(ScalarTypes::INT);
+        declarator->declare(context);
+        return layout;
+    }
+    std::vector<Declarator*> stepped{declarator};
+    if (dynamic_cast<ListType*>(type.get())) {
+        layout.lowering = Layout::Lowering::LIST;
+        layout.state = context.hidden(type);
+        context.hidden(ScalarTypes::INT);
+    } else if (auto tuple = dynamic_cast<TupleDeclarator*>(declarator); tuple && dynamic_cast<DictType*>(type.get())) {
+        layout.lowering = Layout::Lowering::DICT;
+        layout.state = context.hidden(std::make_shared<IterType>(elementof(type)));
+        stepped = {tuple->elements[0].get(), tuple->elements[1].get()};
+    } else {
+        layout.lowering = Layout::Lowering::ITERATOR;
+        layout.state = context.hidden(std::make_shared<IterType>(elementof(type)));
+    }
+    // a named local declared right now takes the very slot its value is stepped into
+    for (size_t i = 0; i < stepped.size(); ++i) {
+        auto simple = dynamic_cast<SimpleDeclarator*>(stepped[i]);
+        if (simple && simple->compiler.of(simple->name->token) != "_") {
+            layout.direct |= 1u << i;
+            simple->declare(context);
+        } else {
+            context.hidden(stepped[i]->typeCache);
+        }
+    }
+    for (size_t i = 0; i < stepped.size(); ++i) {
+        if (!(layout.direct >> i & 1)) stepped[i]->declare(context);
+    }
+    return layout;
+}
+
+std::vector<const Declarator*> ForExpr::steppedDeclarators() const {
+    if (layout.lowering == Layout::Lowering::DICT) {
+        auto tuple = dynamic_cast<TupleDeclarator*>(declarator.get());
+        return {tuple->elements[0].get(), tuple->elements[1].get()};
+    }
+    return {declarator.get()};
+}
+
+void ForExpr::walkDiscardedBytecode(Assembler *assembler) const {
+    switch (layout.lowering) {
+        case Layout::Lowering::ITERATOR:
+        case Layout::Lowering::DICT:
+            initializer->walkBytecode(assembler);
+            assembler->opcode(Opcode::ITER);
+            assembler->indexed(Opcode::STORE, layout.state);
+            assembler->opcode(Opcode::POP);
+            walkSteppedBytecode(assembler);
+            break;
+        case Layout::Lowering::LIST:
+            initializer->walkBytecode(assembler);
+            assembler->indexed(Opcode::STORE, layout.state);
+            assembler->opcode(Opcode::POP);
+            assembler->const0();
+            assembler->indexed(Opcode::STORE, layout.state + 1);
+            assembler->opcode(Opcode::POP);
+            walkSteppedBytecode(assembler);
+            break;
+        case Layout::Lowering::RANGE:
+            walkCountedBytecode(assembler);
+            break;
+    }
+}
+
+// optimization: the iterator or the list with its index is kept in hidden locals instead of on the stack,
+// and a single instruction steps it, storing the element and taking the following JMP0 at the end.
+// The entries of a dict destructured right away are stored as a key and a value, and no pair is allocated.
+void ForExpr::walkSteppedBytecode(Assembler* assembler) const {
     size_t A = compiler.continuum->labelUntil++;
     size_t B = compiler.continuum->labelUntil++;
     breakpoint = B;
-    initializer->walkBytecode(assembler);
-    assembler->opcode(Opcode::ITER);
+    bool list = layout.lowering == Layout::Lowering::LIST;
+    size_t first = layout.state + (list ? 2 : 1);
     assembler->label(A);
-    assembler->opcode(Opcode::DUP);
-    assembler->opcode(Opcode::MOVE);
+    assembler->indexed(list ? Opcode::LNEXT : layout.lowering == Layout::Lowering::DICT ? Opcode::DNEXT : Opcode::NEXT, layout.state);
     assembler->labeled(Opcode::JMP0, B);
-    assembler->opcode(Opcode::DUP);
-    assembler->opcode(Opcode::GET);
-    declarator->walkBytecode(assembler);
+    auto stepped = steppedDeclarators();
+    for (size_t i = 0; i < stepped.size(); ++i) {
+        if (layout.direct >> i & 1) continue;
+        assembler->indexed(Opcode::LOAD, first + i);
+        stepped[i]->walkBytecode(assembler);
+        assembler->opcode(Opcode::POP);
+    }
+    clause->walkDiscardedBytecode(assembler);
+    assembler->labeled(Opcode::JMP, A);
+    assembler->label(B);
+    // release the collection as soon as the loop is over
+    assembler->const0();
+    assembler->indexed(Opcode::STORE, layout.state);
     assembler->opcode(Opcode::POP);
-    clause->walkBytecode(assembler);
+}
+
+// optimization: a range with constant step is counted in hidden locals, and no iterator is allocated.
+void ForExpr::walkCountedBytecode(Assembler* assembler) const {
+    size_t A = compiler.continuum->labelUntil++;
+    size_t B = compiler.continuum->labelUntil++;
+    breakpoint = B;
+    auto range = countedRange(initializer.get());
+    int64_t step = range->rhs[2]->requireConst().$int;
+    size_t cursor = layout.state, bound = layout.state + 1;
+    range->rhs[0]->walkBytecode(assembler);
+    assembler->indexed(Opcode::STORE, cursor);
+    assembler->opcode(Opcode::POP);
+    range->rhs[1]->walkBytecode(assembler);
+    assembler->indexed(Opcode::STORE, bound);
+    assembler->opcode(Opcode::POP);
+    assembler->label(A);
+    assembler->indexed(Opcode::LOAD, cursor);
+    assembler->indexed(Opcode::LOAD, bound);
+    assembler->indexed(Opcode::ICMP, step > 0 ? 2 : 3);
+    assembler->labeled(Opcode::JMP0, B);
+    assembler->indexed(Opcode::LOAD, cursor);
+    declarator->walkBytecode(assembler);
     assembler->opcode(Opcode::POP);
+    clause->walkDiscardedBytecode(assembler);
+    if (step == 1 || step == -1) {
+        // the cursor is still short of the bound, so it never overflows by one
+        assembler->indexed(step == 1 ? Opcode::INC : Opcode::DEC, cursor);
+    } else {
+        // the loop ends before stepping would overflow, as it would have passed the bound anyway
+        assembler->indexed(Opcode::LOAD, cursor);
+        assembler->const_(step > 0 ? std::numeric_limits<int64_t>::max() - step : std::numeric_limits<int64_t>::min() - step);
+        assembler->indexed(Opcode::ICMP, step > 0 ? 4 : 5);
+        assembler->labeled(Opcode::JMP0, B);
+        assembler->indexed(Opcode::LOAD, cursor);
+        assembler->const_(step);
+        assembler->opcode(Opcode::IADD);
+        assembler->indexed(Opcode::STORE, cursor);
+        assembler->opcode(Opcode::POP);
+    }
     assembler->labeled(Opcode::JMP, A);
     assembler->label(B);
-    assembler->opcode(Opcode::POP);
-    assembler->const0();
 }
 
 TypeReference YieldReturnExpr::evalType(TypeReference const& infer) const {
@@ -42,6 +42,9 @@ struct Expr : Descriptor {
 
     virtual void walkBytecode(Assembler* assembler) const = 0;
 
+    // Emits bytecode for an expression whose value is unused, leaving nothing on the stack
+    virtual void walkDiscardedBytecode(Assembler* assembler) const;
+
     void expect(TypeReference const& expected) const;
 
     void expect(bool pred(TypeReference const&), const char* expected) const;
@@ -339,6 +342,8 @@ struct AssignExpr : Expr {
     [[nodiscard]] TypeReference evalType(TypeReference const& infer) const override;
 
     void walkBytecode(Assembler* assembler) const override;
+
+    void walkDiscardedBytecode(Assembler* assembler) const override;
 };
 
 struct AccessExpr : AssignableExpr {
@@ -597,6 +602,8 @@ struct ClauseExpr : Expr {
     [[nodiscard]] std::optional<$union> evalConst() const override;
 
     void walkBytecode(Assembler* assembler) const override;
+
+    void walkDiscardedBytecode(Assembler* assembler) const override;
 };
 
 struct IfElseExpr : Expr {
@@ -621,6 +628,8 @@ struct IfElseExpr : Expr {
 
     void walkBytecode(Assembler* assembler) const override;
 
+    void walkDiscardedBytecode(Assembler* assembler) const override;
+
     static void walkBytecode(Expr const* cond, Expr const* lhs, Expr const* rhs, Compiler& compiler, Assembler* assembler);
 };
 
@@ -666,6 +675,8 @@ struct LoopExpr : Expr {
     [[nodiscard]] Segment segment() const override {
         return range(token, clause->segment());
     }
+
+    void walkBytecode(Assembler* assembler) const override;
 };
 
 struct WhileExpr : LoopExpr {
@@ -679,7 +690,7 @@ struct WhileExpr : LoopExpr {
 
     [[nodiscard]] TypeReference evalType(TypeReference const& infer) const override;
 
-    void walkBytecode(Assembler* assembler) const override;
+    void walkDiscardedBytecode(Assembler* assembler) const override;
 };
 
 struct ReturnExpr : Expr {
@@ -869,12 +880,27 @@ struct LetExpr : Expr {
     [[nodiscard]] TypeReference evalType(TypeReference const& infer) const override;
 
     void walkBytecode(Assembler* assembler) const override;
+
+    void walkDiscardedBytecode(Assembler* assembler) const override;
 };
 
 struct ForExpr : LoopExpr {
     DeclaratorHandle declarator;
     ExprHandle initializer;
 
+
+    // how the loop steps, keeping its state in hidden locals from `state` on
+    struct Layout {
+        enum class Lowering {
+            ITERATOR, // the iterator at state, then the element
+            LIST,     // the list at state, the index at state + 1, then the element
+            RANGE,    // the cursor at state, the bound at state + 1
+            DICT,     // the iterator at state, then the key and the value
+        } lowering;
+        size_t state;
+        unsigned direct; // bit i is set if the i-th stepped value goes right into its declared local
+    } layout{};
+
     ForExpr(Compiler& compiler, Token token, DeclaratorHandle declarator, ExprHandle initializer, ExprHandle clause, std::shared_ptr<LoopHook> hook):
             declarator(std::move(declarator)), initializer(std::move(initializer)), LoopExpr(compiler, token, std::move(clause), std::move(hook)) {}
 
@@ -883,7 +909,18 @@ struct ForExpr : LoopExpr {
 
     [[nodiscard]] TypeReference evalType(TypeReference const& infer) const override;
 
-    void walkBytecode(Assembler* assembler) const override;
+    [[nodiscard]] static const InvokeExpr* countedRange(const Expr* initializer);
+
+    // allocates the hidden locals of the loop and declares the declarator right after them
+    static Layout declare(LocalContext& context, Declarator* declarator, const Expr* initializer);
+
+    void walkDiscardedBytecode(Assembler* assembler) const override;
+
+    [[nodiscard]] std::vector<const Declarator*> steppedDeclarators() const;
+
+    void walkSteppedBytecode(Assembler* assembler) const;
+
+    void walkCountedBytecode(Assembler* assembler) const;
 };
 
 struct YieldReturnExpr : Expr {
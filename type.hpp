@@ -60,6 +60,9 @@ const std::unordered_map<std::string_view, ScalarTypeKind> SCALAR_TYPES {
 };
 
 struct Type : Descriptor {
+    // Set once the type is hash-consed by intern, so that two distinct interned types are never equal
+    bool interned = false;
+
     [[nodiscard]] virtual std::string toString() const = 0;
     [[nodiscard]] virtual bool equals(const TypeReference& type) const noexcept = 0;
     [[nodiscard]] virtual bool assignableFrom(const TypeReference& type) const noexcept {
@@ -81,6 +84,7 @@ struct ScalarType : Type {
 
     [[nodiscard]] bool equals(const TypeReference& type) const noexcept override {
         if (this == type.get()) return true;
+        if (interned && type && type->interned) return false;
         if (auto scalar = dynamic_cast<const ScalarType*>(type.get())) {
             return scalar->S == S;
         }
@@ -109,15 +113,35 @@ struct ScalarType : Type {
 };
 
 namespace ScalarTypes {
-const TypeReference ANY = std::make_shared<ScalarType>(ScalarTypeKind::ANY);
-const TypeReference NONE = std::make_shared<ScalarType>(ScalarTypeKind::NONE);
-const TypeReference NEVER = std::make_shared<ScalarType>(ScalarTypeKind::NEVER);
-const TypeReference BOOL = std::make_shared<ScalarType>(ScalarTypeKind::BOOL);
-const TypeReference BYTE = std::make_shared<ScalarType>(ScalarTypeKind::BYTE);
-const TypeReference INT = std::make_shared<ScalarType>(ScalarTypeKind::INT);
-const TypeReference FLOAT = std::make_shared<ScalarType>(ScalarTypeKind::FLOAT);
-const TypeReference CHAR = std::make_shared<ScalarType>(ScalarTypeKind::CHAR);
-const TypeReference STRING = std::make_shared<ScalarType>(ScalarTypeKind::STRING);
+[[nodiscard]] inline TypeReference make(ScalarTypeKind S) {
+    auto type = std::make_shared<ScalarType>(S);
+    type->interned = true;
+    return type;
+}
+
+inline const TypeReference ANY = make(ScalarTypeKind::ANY);
+inline const TypeReference NONE = make(ScalarTypeKind::NONE);
+inline const TypeReference NEVER = make(ScalarTypeKind::NEVER);
+inline const TypeReference BOOL = make(ScalarTypeKind::BOOL);
+inline const TypeReference BYTE = make(ScalarTypeKind::BYTE);
+inline const TypeReference INT = make(ScalarTypeKind::INT);
+inline const TypeReference FLOAT = make(ScalarTypeKind::FLOAT);
+inline const TypeReference CHAR = make(ScalarTypeKind::CHAR);
+inline const TypeReference STRING = make(ScalarTypeKind::STRING);
+
+[[nodiscard]] inline TypeReference const& of(ScalarTypeKind S) noexcept {
+    switch (S) {
+        case ScalarTypeKind::ANY: return ANY;
+        case ScalarTypeKind::NONE: return NONE;
+        case ScalarTypeKind::NEVER: return NEVER;
+        case ScalarTypeKind::BOOL: return BOOL;
+        case ScalarTypeKind::BYTE: return BYTE;
+        case ScalarTypeKind::INT: return INT;
+        case ScalarTypeKind::FLOAT: return FLOAT;
+        case ScalarTypeKind::CHAR: return CHAR;
+        default: return STRING;
+    }
+}
 }
 
 [[nodiscard]] inline bool isScalar(TypeReference const& type, ScalarTypeKind kind) noexcept {
@@ -206,6 +230,7 @@ struct TupleType : Type {
 
     [[nodiscard]] bool equals(const TypeReference& type) const noexcept override {
         if (this == type.get()) return true;
+        if (interned && type && type->interned) return false;
         if (auto tuple = dynamic_cast<const TupleType*>(type.get())) {
             return std::equal(E.begin(), E.end(), tuple->E.begin(), tuple->E.end(),
                               [](const TypeReference& type1, const TypeReference& type2) { return type1->equals(type2); });
@@ -247,6 +272,7 @@ struct ListType : Type {
 
     [[nodiscard]] bool equals(const TypeReference& type) const noexcept override {
         if (this == type.get()) return true;
+        if (interned && type && type->interned) return false;
         if (auto list = dynamic_cast<const ListType*>(type.get())) {
             return list->E->equals(E);
         }
@@ -272,6 +298,7 @@ struct SetType : Type {
 
     [[nodiscard]] bool equals(const TypeReference& type) const noexcept override {
         if (this == type.get()) return true;
+        if (interned && type && type->interned) return false;
         if (auto list = dynamic_cast<const SetType*>(type.get())) {
             return list->E->equals(E);
         }
@@ -297,6 +324,7 @@ struct DictType : Type {
 
     [[nodiscard]] bool equals(const TypeReference& type) const noexcept override {
         if (this == type.get()) return true;
+        if (interned && type && type->interned) return false;
         if (auto dict = dynamic_cast<const DictType*>(type.get())) {
             return dict->K->equals(K) && dict->V->equals(V);
         }
@@ -331,6 +359,7 @@ struct FuncType : Type {
 
     [[nodiscard]] bool equals(const TypeReference& type) const noexcept override {
         if (this == type.get()) return true;
+        if (interned && type && type->interned) return false;
         if (auto func = dynamic_cast<const FuncType*>(type.get())) {
             return func->R->equals(R) &&
             std::equal(P.begin(), P.end(), func->P.begin(), func->P.end(),
@@ -375,6 +404,7 @@ struct IterType : Type {
 
     [[nodiscard]] bool equals(const TypeReference& type) const noexcept override {
         if (this == type.get()) return true;
+        if (interned && type && type->interned) return false;
         if (auto iter = dynamic_cast<const IterType*>(type.get())) {
             return iter->E->equals(E);
         }
@@ -397,6 +427,20 @@ struct IterType : Type {
     }
 };
 
+// Returns the shared instance structurally equal to type, so that checks between interned types are mostly pointer comparisons.
+// Types with a component not interned yet, such as a function whose return type is still being inferred, are returned as is.
+[[nodiscard]] inline TypeReference intern(TypeReference type) {
+    static std::unordered_map<std::string, TypeReference> types;
+    if (type->interned) return type;
+    if (auto scalar = dynamic_cast<ScalarType*>(type.get())) return ScalarTypes::of(scalar->S);
+    for (auto&& child : type->children()) {
+        if (!child || !static_cast<const Type*>(child)->interned) return type;
+    }
+    auto it = types.try_emplace(type->serialize(), type).first;
+    it->second->interned = true;
+    return it->second;
+}
+
 [[nodiscard]] inline TypeReference eithertype(TypeReference const& type1, TypeReference const& type2) noexcept {
     if (type1->equals(type2)) return type1;
     if (isNever(type1)) return type2;
@@ -411,7 +455,7 @@ struct IterType : Type {
     } else if (auto list = dynamic_cast<ListType*>(type.get())) {
         return list->E;
     } else if (auto dict = dynamic_cast<DictType*>(type.get())) {
-        return std::make_shared<TupleType>(std::vector{dict->K, dict->V});
+        return intern(std::make_shared<TupleType>(std::vector{dict->K, dict->V}));
     } else if (auto iter = dynamic_cast<IterType*>(type.get())) {
         if (forbid) return nullptr;
         return iter->E;
@@ -437,14 +481,14 @@ inline TypeReference deserialize(const char*& str) {
                 elements.emplace_back(deserialize(str));
             }
             ++str;
-            return std::make_shared<TupleType>(std::move(elements));
+            return intern(std::make_shared<TupleType>(std::move(elements)));
         }
-        case '[': return std::make_shared<ListType>(deserialize(str));
-        case '{': return std::make_shared<SetType>(deserialize(str));
+        case '[': return intern(std::make_shared<ListType>(deserialize(str)));
+        case '{': return intern(std::make_shared<SetType>(deserialize(str)));
         case '@': {
             auto key = deserialize(str);
             auto value = deserialize(str);
-            return std::make_shared<DictType>(std::move(key), std::move(value));
+            return intern(std::make_shared<DictType>(std::move(key), std::move(value)));
         }
         case '$': {
             std::vector<TypeReference> parameters;
@@ -452,9 +496,10 @@ inline TypeReference deserialize(const char*& str) {
                 parameters.emplace_back(deserialize(str));
             }
             ++str;
-            return std::make_shared<FuncType>(std::move(parameters), deserialize(str));
+            auto result = deserialize(str);
+            return intern(std::make_shared<FuncType>(std::move(parameters), std::move(result)));
         }
-        case '*': return std::make_shared<IterType>(deserialize(str));
+        case '*': return intern(std::make_shared<IterType>(deserialize(str)));
     }
     std::string msg = "error to deserialize type at ";
     msg += --str;